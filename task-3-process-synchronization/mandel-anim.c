@@ -0,0 +1,434 @@
+/*
+ * mandel-anim.c
+ *
+ * Zoom animations. The keyframe file has a view per line,
+ *
+ *   cx,cy,r [frames]
+ *
+ * as for -v, and every keyframe after the first is reached in frames
+ * frames from the one before it, ANIM_FRAMES if not given. Lines
+ * starting with # are comments. Every frame is an image file, named
+ * by a printf pattern with the frame number.
+ *
+ * Frames go through three stages, which overlap:
+ *
+ *   setup    the main thread works out the view of the next frame,
+ *            and its reference orbit for deep zooms
+ *   compute  a pool of workers takes rows from the oldest frame that
+ *            still has any, and goes on with the next frame as soon
+ *            as the rows of one run out, so there is no barrier
+ *            between frames
+ *   encode   a writer thread colors and encodes the rows of the
+ *            oldest frame as they complete, and writes out its file
+ *
+ * Up to ANIM_IN_FLIGHT frames are in flight, so the workers do not
+ * wait for frames to be written, only for the next one to be set up.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mandel-lib.h"
+#include "mandel-dd.h"
+#include "mandel-deep.h"
+#include "mandel-image.h"
+#include "mandel-anim.h"
+
+#define KEYFRAME_LINE_MAX 1024
+
+struct keyframe {
+	dd cx, cy;
+	double r;
+	int frames;                /* frames from the keyframe before */
+};
+
+/*
+ * A frame in flight. Rows are handed out to the pool
+ * in order; ready[r] is set once row r is in iter[].
+ */
+struct frame {
+	int number;
+	struct mandel_params params;
+	struct mandel_deep deep;
+	int *iter;
+	char *ready;
+	int next_row;              /* next row to hand out */
+	struct frame *next_work;   /* next frame with rows to hand out */
+	struct frame *next;        /* next frame in flight */
+};
+
+/*
+ * One lock for all that is shared: the frames that still have rows to
+ * hand out, the frames in flight, oldest first, and their ready rows.
+ */
+static pthread_mutex_t anim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t anim_work = PTHREAD_COND_INITIALIZER;   /* rows to hand out, or the end */
+static pthread_cond_t anim_row = PTHREAD_COND_INITIALIZER;    /* a frame or a row got ready */
+static pthread_cond_t anim_slot = PTHREAD_COND_INITIALIZER;   /* a frame was written */
+static struct frame *work_head, *work_tail;
+static struct frame *flight_head, *flight_tail;
+static int in_flight, setup_done;
+
+/* What the writer needs to know */
+static const char *anim_pattern;
+static int anim_format, anim_colors, anim_frames;
+
+/*
+ * Parse a keyframe, "cx,cy,r [frames]".
+ */
+static int parse_keyframe(char *s, struct keyframe *k)
+{
+	char *p;
+
+	if (dd_parse(s, &k->cx, &p) < 0 || *p++ != ',')
+		return -1;
+	if (dd_parse(p, &k->cy, &p) < 0 || *p++ != ',')
+		return -1;
+	k->r = strtod(p, &p);
+	if (!(k->r > 0))
+		return -1;
+
+	k->frames = ANIM_FRAMES;
+	p += strspn(p, " \t\r\n");
+	if (*p != '\0') {
+		k->frames = strtol(p, &p, 10);
+		if (k->frames <= 0)
+			return -1;
+		p += strspn(p, " \t\r\n");
+	}
+	return (*p == '\0') ? 0 : -1;
+}
+
+/*
+ * Read the keyframes in path into *keys, return how many there are.
+ */
+static int load_keyframes(const char *path, struct keyframe **keys)
+{
+	char line[KEYFRAME_LINE_MAX], *p;
+	struct keyframe *k = NULL, *tmp;
+	int n = 0, lineno = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror("load_keyframes: fopen");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		p = line + strspn(line, " \t\r\n");
+		if (*p == '#' || *p == '\0')
+			continue;
+
+		if ((tmp = realloc(k, (n + 1) * sizeof(*k))) == NULL) {
+			perror("load_keyframes: realloc");
+			exit(1);
+		}
+		k = tmp;
+		if (parse_keyframe(p, &k[n]) < 0) {
+			fprintf(stderr, "%s:%d: expected cx,cy,r [frames]\n", path, lineno);
+			exit(1);
+		}
+		n++;
+	}
+	fclose(f);
+
+	if (n == 0) {
+		fprintf(stderr, "%s: no keyframes\n", path);
+		exit(1);
+	}
+	*keys = k;
+	return n;
+}
+
+/*
+ * Whether pattern has exactly one conversion, a %d with
+ * flags and a width at most, so it can name the frame files.
+ */
+static int check_pattern(const char *pattern)
+{
+	const char *p;
+	int n = 0;
+
+	for (p = pattern; *p != '\0'; p++) {
+		if (*p != '%')
+			continue;
+		if (*++p == '%')
+			continue;
+		p += strspn(p, "-+ #0");
+		p += strspn(p, "0123456789");
+		if (*p != 'd')
+			return -1;
+		n++;
+	}
+	return (n == 1) ? 0 : -1;
+}
+
+/*
+ * The view t of the way from keyframe a to keyframe b, 0 < t < 1.
+ * The radius changes by the same factor every frame. The center moves
+ * in step with the radius, so that the point both views close in on
+ * stays at the same place in the picture.
+ */
+static void interpolate(const struct keyframe *a, const struct keyframe *b, double t,
+	dd *cx, dd *cy, double *r)
+{
+	double s;
+
+	*r = a->r * pow(b->r / a->r, t);
+	s = (a->r != b->r) ? (a->r - *r) / (a->r - b->r) : t;
+	*cx = dd_add(a->cx, dd_mul_d(dd_sub(b->cx, a->cx), s));
+	*cy = dd_add(a->cy, dd_mul_d(dd_sub(b->cy, a->cy), s));
+}
+
+static struct frame *frame_new(int number, const struct mandel_params *set,
+	dd cx, dd cy, double r)
+{
+	struct frame *f;
+
+	if ((f = malloc(sizeof(*f))) == NULL) {
+		perror("frame_new: malloc");
+		exit(1);
+	}
+	f->number = number;
+	f->params = *set;
+	if (deep_view(&f->params, &f->deep, set->width, set->height, cx, cy, r, set->max) < 0) {
+		perror("frame_new: deep_view");
+		exit(1);
+	}
+	f->iter = malloc((size_t)set->width * set->height * sizeof(*f->iter));
+	f->ready = calloc(set->height, sizeof(*f->ready));
+	if (f->iter == NULL || f->ready == NULL) {
+		perror("frame_new: malloc");
+		exit(1);
+	}
+	f->next_row = 0;
+	f->next_work = f->next = NULL;
+	return f;
+}
+
+static void frame_free(struct frame *f)
+{
+	if (f->params.deep != NULL)
+		deep_free(&f->deep);
+	free(f->iter);
+	free(f->ready);
+	free(f);
+}
+
+/*
+ * Compute stage: rows of the oldest frame that has any left,
+ * until every frame has been set up and handed out.
+ */
+static void *anim_worker(void *arg)
+{
+	struct frame *f;
+	int row;
+
+	pthread_mutex_lock(&anim_lock);
+	for (;;) {
+		while (work_head == NULL && !setup_done)
+			pthread_cond_wait(&anim_work, &anim_lock);
+		if (work_head == NULL)
+			break;
+
+		/* Take the next row, move on to the next frame after the last one */
+		f = work_head;
+		row = f->next_row++;
+		if (f->next_row == f->params.height) {
+			work_head = f->next_work;
+			if (work_head == NULL)
+				work_tail = NULL;
+		}
+		pthread_mutex_unlock(&anim_lock);
+
+		mandel_render_span(&f->params, row, 0, f->params.width,
+			&f->iter[(size_t)row * f->params.width], NULL);
+
+		pthread_mutex_lock(&anim_lock);
+		f->ready[row] = 1;
+		pthread_cond_signal(&anim_row);
+	}
+	pthread_mutex_unlock(&anim_lock);
+
+	return NULL;
+}
+
+/*
+ * Encode stage: the frames in order, every row colored and encoded
+ * into the file image as soon as it is ready, and the file written
+ * at once when the frame is complete.
+ */
+static void *anim_writer(void *arg)
+{
+	char path[4096], header[IMAGE_HEADER_MAX];
+	unsigned char *out = NULL;
+	struct frame *f;
+	size_t hlen = 0, bpp, rowlen = 0, size = 0;
+	int n, r, fd;
+
+	for (n = 0; n < anim_frames; n++) {
+		pthread_mutex_lock(&anim_lock);
+		while (flight_head == NULL)
+			pthread_cond_wait(&anim_row, &anim_lock);
+		f = flight_head;
+		pthread_mutex_unlock(&anim_lock);
+
+		/* All frames have the same size and header, set up the file image once */
+		if (out == NULL) {
+			hlen = image_header(header, anim_format, f->params.width, f->params.height, &bpp);
+			rowlen = f->params.width * bpp;
+			size = hlen + rowlen * f->params.height;
+			if ((out = malloc(size)) == NULL) {
+				perror("anim_writer: malloc");
+				exit(1);
+			}
+			memcpy(out, header, hlen);
+		}
+
+		for (r = 0; r < f->params.height; r++) {
+			pthread_mutex_lock(&anim_lock);
+			while (!f->ready[r])
+				pthread_cond_wait(&anim_row, &anim_lock);
+			pthread_mutex_unlock(&anim_lock);
+
+			image_encode(out + hlen + r * rowlen, anim_format, anim_colors, f->params.max,
+				&f->iter[(size_t)r * f->params.width], f->params.width);
+		}
+
+		snprintf(path, sizeof(path), anim_pattern, f->number);
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+			perror("anim_writer: open");
+			exit(1);
+		}
+		if (insist_write(fd, (char *)out, size) != size || close(fd) < 0) {
+			perror("anim_writer: write");
+			exit(1);
+		}
+
+		/* Done with the frame, make room for the next one */
+		pthread_mutex_lock(&anim_lock);
+		flight_head = f->next;
+		if (flight_head == NULL)
+			flight_tail = NULL;
+		in_flight--;
+		pthread_cond_signal(&anim_slot);
+		pthread_mutex_unlock(&anim_lock);
+		frame_free(f);
+	}
+
+	free(out);
+	return NULL;
+}
+
+/*
+ * Set up stage: put frame number n, of view (cx, cy, r), in flight,
+ * once there is room for it.
+ */
+static void anim_frame(int n, const struct mandel_params *set, dd cx, dd cy, double r)
+{
+	struct frame *f;
+
+	pthread_mutex_lock(&anim_lock);
+	while (in_flight == ANIM_IN_FLIGHT)
+		pthread_cond_wait(&anim_slot, &anim_lock);
+	in_flight++;
+	pthread_mutex_unlock(&anim_lock);
+
+	f = frame_new(n, set, cx, cy, r);
+
+	pthread_mutex_lock(&anim_lock);
+	if (work_tail != NULL)
+		work_tail->next_work = f;
+	else
+		work_head = f;
+	work_tail = f;
+	if (flight_tail != NULL)
+		flight_tail->next = f;
+	else
+		flight_head = f;
+	flight_tail = f;
+	pthread_cond_broadcast(&anim_work);
+	pthread_cond_signal(&anim_row);
+	pthread_mutex_unlock(&anim_lock);
+}
+
+/*
+ * Render the zoom along the keyframes in file keyframes, into
+ * files named by pattern, in format and color mapping colors,
+ * with a pool of nworkers threads. set has the size, the iteration
+ * limit and the set of the frames, the keyframes have their views.
+ */
+void anim_run(const char *keyframes, const char *pattern, int format, int colors,
+	const struct mandel_params *set, int nworkers)
+{
+	struct keyframe *keys;
+	struct timespec t0, t1;
+	pthread_t *tid, writer;
+	double r, wall;
+	int nkeys, k, i, n;
+	dd cx, cy;
+
+	if (check_pattern(pattern) < 0) {
+		fprintf(stderr, "anim_run: `%s' needs a single %%d for the frame number\n", pattern);
+		exit(1);
+	}
+	nkeys = load_keyframes(keyframes, &keys);
+
+	anim_pattern = pattern;
+	anim_format = format;
+	anim_colors = colors;
+	for (k = 1, anim_frames = 1; k < nkeys; k++)
+		anim_frames += keys[k].frames;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if ((tid = calloc(nworkers, sizeof(*tid))) == NULL) {
+		perror("anim_run: calloc");
+		exit(1);
+	}
+	for (i = 0; i < nworkers; i++) {
+		if ((errno = pthread_create(&tid[i], NULL, anim_worker, NULL)) != 0) {
+			perror("anim_run: pthread_create");
+			exit(1);
+		}
+	}
+	if ((errno = pthread_create(&writer, NULL, anim_writer, NULL)) != 0) {
+		perror("anim_run: pthread_create");
+		exit(1);
+	}
+
+	/* The first keyframe, then the way to every next one, ending on it */
+	anim_frame(0, set, keys[0].cx, keys[0].cy, keys[0].r);
+	for (k = 1, n = 1; k < nkeys; k++) {
+		for (i = 1; i < keys[k].frames; i++) {
+			interpolate(&keys[k - 1], &keys[k], (double)i / keys[k].frames, &cx, &cy, &r);
+			anim_frame(n++, set, cx, cy, r);
+		}
+		anim_frame(n++, set, keys[k].cx, keys[k].cy, keys[k].r);
+	}
+
+	pthread_mutex_lock(&anim_lock);
+	setup_done = 1;
+	pthread_cond_broadcast(&anim_work);
+	pthread_mutex_unlock(&anim_lock);
+
+	for (i = 0; i < nworkers; i++)
+		pthread_join(tid[i], NULL);
+	pthread_join(writer, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	fprintf(stderr, "%d frames of %dx%d in %.3fs, %.1f frames/s, %d workers, kernel %s\n",
+		anim_frames, set->width, set->height, wall, anim_frames / wall,
+		nworkers, mandel_kernel_name());
+
+	free(tid);
+	free(keys);
+}
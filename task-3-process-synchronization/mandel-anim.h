@@ -0,0 +1,28 @@
+/*
+ * mandel-anim.h
+ *
+ * Zoom animations along a path of keyframes, rendered to one image
+ * file per frame, with several frames in flight at the same time.
+ *
+ */
+
+#ifndef MANDEL_ANIM_H__
+#define MANDEL_ANIM_H__
+
+#include "mandel-lib.h"
+
+/* Frames between keyframes that do not say */
+#define ANIM_FRAMES 30
+
+/*
+ * Frames set up, being computed or being written at the same time.
+ * Enough for the workers to go on with the next frames while
+ * one is written out.
+ */
+#define ANIM_IN_FLIGHT 4
+
+/* Function prototypes */
+void anim_run(const char *keyframes, const char *pattern, int format, int colors,
+	const struct mandel_params *set, int nworkers);
+
+#endif /* MANDEL_ANIM_H__ */
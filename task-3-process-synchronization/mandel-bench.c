@@ -0,0 +1,168 @@
+/*
+ * mandel-bench.c
+ *
+ * A benchmark driver for mandel.
+ *
+ * Renders a fixed set of reference views at several sizes, iteration
+ * limits and worker counts, running mandel once for each combination.
+ * Every run writes a raw image to a temporary file, so the terminal
+ * is not part of the measurement, and reports its statistics with -b.
+ * Those are collected through a pipe and printed on stdout as one line
+ * of JSON per run, tagged with the name of the view. Runs use -K, so
+ * that the cost map of one does not change the chunks of the next,
+ * and without the profile saved by mandel -A, so that they measure
+ * the defaults, like the best kernel for the machine.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "proc-common.h"
+
+/*
+ * The reference views: name, "cx,cy,r" (NULL for the default view),
+ * and whether they need the deep zoom engine.
+ */
+static const struct {
+	const char *name;
+	const char *view;
+	int deep;
+} regions[] = {
+	{ "full",     NULL, 0 },
+	{ "seahorse", "-0.75,0.1,0.05", 0 },
+	{ "elephant", "0.275,0.006,0.01", 0 },
+	{ "interior", "-0.1,0.1,0.2", 0 },
+	{ "spiral",   "-0.743643887037158704752191506114774,0.131825904205311970493132056385139,1e-6", 0 },
+	{ "deep",     "-0.743643887037158704752191506114774,0.131825904205311970493132056385139,1e-20", 1 },
+	{ NULL, NULL, 0 }
+};
+
+static const char *sizes[] = { "320x240", "800x600", NULL };
+static const char *iterations[] = { "1000", "100000", NULL };
+
+/*
+ * Run mandel once with the given arguments, and print the
+ * line of JSON it reports, with the view name added to it.
+ */
+static void run(const char *mandel, const char *name, char *argv[])
+{
+	int pfd[2], status;
+	char line[4096];
+	FILE *f;
+	pid_t p;
+
+	if (pipe(pfd) < 0) {
+		perror("run: pipe");
+		exit(1);
+	}
+
+	fflush(stdout);
+	p = fork();
+	if (p < 0) {
+		perror("run: fork");
+		exit(1);
+	}
+	if (p == 0) {
+		/* Child: statistics go to the pipe, everything else away */
+		close(pfd[0]);
+		if (dup2(pfd[1], 2) < 0 || freopen("/dev/null", "w", stdout) == NULL) {
+			perror("run: redirect");
+			exit(1);
+		}
+		execv(mandel, argv);
+		perror("run: execv");
+		exit(1);
+	}
+
+	close(pfd[1]);
+	f = fdopen(pfd[0], "r");
+	if (f == NULL) {
+		perror("run: fdopen");
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+		if (line[0] == '{')
+			printf("{\"region\":\"%s\",%s", name, line + 1);
+	fclose(f);
+
+	if (waitpid(p, &status, 0) < 0) {
+		perror("run: waitpid");
+		exit(1);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		explain_wait_status(p, status);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mandel = "./mandel";
+	char tmp[] = "/tmp/mandel-bench-XXXXXX";
+	char workers[16];
+	char *args[32];
+	int r, s, i, w, n, fd, ncpu, quick = 0;
+	int nworkers[2];
+
+	if (argc > 1 && strcmp(argv[1], "-q") == 0) {
+		quick = 1;
+		argc--;
+		argv++;
+	}
+	if (argc > 1)
+		mandel = argv[1];
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		perror("mkstemp");
+		exit(1);
+	}
+	close(fd);
+
+	/* Settings from the profile would override the defaults being measured */
+	if (setenv("MANDEL_PROFILE", "/dev/null", 1) < 0) {
+		perror("setenv");
+		exit(1);
+	}
+
+	/* One worker, and one per online CPU */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nworkers[0] = 1;
+	nworkers[1] = (ncpu > 1) ? ncpu : 0;
+
+	for (r = 0; regions[r].name != NULL; r++)
+		for (s = 0; sizes[s] != NULL && !(quick && s > 0); s++)
+			for (i = 0; iterations[i] != NULL && !(quick && i > 0); i++)
+				for (w = 0; w < 2 && nworkers[w] > 0; w++) {
+					snprintf(workers, sizeof(workers), "%d", nworkers[w]);
+					n = 0;
+					args[n++] = (char *)mandel;
+					args[n++] = "-b";
+					args[n++] = "-K";
+					args[n++] = "-t";
+					args[n++] = "-n";
+					args[n++] = workers;
+					args[n++] = "-s";
+					args[n++] = (char *)sizes[s];
+					args[n++] = "-i";
+					args[n++] = (char *)iterations[i];
+					args[n++] = "-F";
+					args[n++] = "raw";
+					args[n++] = "-o";
+					args[n++] = tmp;
+					if (regions[r].view) {
+						args[n++] = "-v";
+						args[n++] = (char *)regions[r].view;
+					}
+					if (regions[r].deep)
+						args[n++] = "-Z";
+					args[n] = NULL;
+					run(mandel, regions[r].name, args);
+				}
+
+	unlink(tmp);
+	return 0;
+}
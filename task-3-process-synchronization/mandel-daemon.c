@@ -0,0 +1,332 @@
+/*
+ * mandel-daemon.c
+ *
+ * A render server. A pool of worker threads is started once; every
+ * client of the Unix domain socket gets a thread of its own, which
+ * queues its request as a job for the pool and streams the image
+ * back row by row, in order, as the rows complete.
+ *
+ * A request is one line of space separated key=value pairs:
+ *
+ *   size=WxH       image size in pixels, default 640x480
+ *   view=cx,cy,r   center and half width of the view, default -0.4,0,1.4
+ *   iter=max       iteration limit, default the one of the daemon
+ *   format=fmt     ppm (default), pgm or raw, as for -F
+ *   colors=map     color mapping of ppm: clamp (default), cycle or log, as for -C
+ *   julia=cx,cy    draw the Julia set for c = cx + i cy instead
+ *
+ * The reply is the image file, or a line starting with "error:",
+ * and then the connection is closed. Views too deep for double
+ * precision are rendered by perturbation, as with -Z. Requests are
+ * limited to DAEMON_MAX_PIXELS and DAEMON_MAX_ITER, and one that
+ * the daemon has no memory for gets an error, like a bad one.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mandel-lib.h"
+#include "mandel-dd.h"
+#include "mandel-deep.h"
+#include "mandel-image.h"
+#include "mandel-daemon.h"
+
+#define REQUEST_MAX 1024
+
+/*
+ * A request being rendered. Rows are handed out to the pool
+ * in order; ready[r] is set once row r is in iter[].
+ */
+struct job {
+	struct mandel_params params;
+	struct mandel_deep deep;
+	int format;
+	int colors;                /* color mapping, see mandel_color_index() */
+	int *iter;
+	char *ready;
+	int next_row;              /* next row to hand out */
+	pthread_cond_t row_done;   /* signalled when a row gets ready */
+	struct job *next;          /* next job in the queue */
+};
+
+/*
+ * The pool: jobs that still have rows to hand out, and one lock
+ * for the queue and for the ready flags of all jobs.
+ */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static struct job *queue_head, *queue_tail;
+
+static int default_max;
+
+static void *pool_worker(void *arg)
+{
+	struct job *j;
+	int row;
+
+	pthread_mutex_lock(&pool_lock);
+	for (;;) {
+		while (queue_head == NULL)
+			pthread_cond_wait(&pool_work, &pool_lock);
+
+		/* Take the next row of the oldest job, dequeue the job after its last row */
+		j = queue_head;
+		row = j->next_row++;
+		if (j->next_row == j->params.height) {
+			queue_head = j->next;
+			if (queue_head == NULL)
+				queue_tail = NULL;
+		}
+		pthread_mutex_unlock(&pool_lock);
+
+		mandel_render_span(&j->params, row, 0, j->params.width,
+			&j->iter[(size_t)row * j->params.width], NULL);
+
+		pthread_mutex_lock(&pool_lock);
+		j->ready[row] = 1;
+		pthread_cond_signal(&j->row_done);
+	}
+
+	return NULL;
+}
+
+/*
+ * Fill in j from the request in line. Return NULL, or what is wrong.
+ */
+static const char *parse_request(struct job *j, char *line)
+{
+	int width = 640, height = 480, max = default_max, julia = 0;
+	double r = 1.4, jx = 0, jy = 0;
+	long n;
+	dd cx = dd_from_double(-0.4), cy = dd_from_double(0.0);
+	char *tok, *val, *p, *save;
+
+	j->format = IMAGE_PPM;
+	j->colors = MANDEL_COLOR_CLAMP;
+	for (tok = strtok_r(line, " \t\r\n", &save); tok != NULL;
+	     tok = strtok_r(NULL, " \t\r\n", &save)) {
+		if ((val = strchr(tok, '=')) == NULL)
+			return "expected key=value";
+		*val++ = '\0';
+
+		if (strcmp(tok, "size") == 0) {
+			if (sscanf(val, "%dx%d", &width, &height) != 2 ||
+			    width <= 0 || height <= 0 ||
+			    width > DAEMON_MAX_SIZE || height > DAEMON_MAX_SIZE ||
+			    (long)width * height > DAEMON_MAX_PIXELS)
+				return "bad size";
+		} else if (strcmp(tok, "view") == 0) {
+			if (dd_parse(val, &cx, &p) < 0 || *p++ != ',' ||
+			    dd_parse(p, &cy, &p) < 0 || *p++ != ',')
+				return "bad view";
+			r = strtod(p, &p);
+			if (*p != '\0' || !(r > 0))
+				return "bad view";
+		} else if (strcmp(tok, "iter") == 0) {
+			errno = 0;
+			n = strtol(val, &p, 10);
+			if (*p != '\0' || errno != 0 || n <= 0 || n > DAEMON_MAX_ITER)
+				return "bad iter";
+			max = n;
+		} else if (strcmp(tok, "format") == 0) {
+			if ((j->format = image_format(val)) < 0)
+				return "bad format";
+		} else if (strcmp(tok, "colors") == 0) {
+			if ((j->colors = mandel_color_map(val)) < 0)
+				return "bad colors";
+		} else if (strcmp(tok, "julia") == 0) {
+			if (sscanf(val, "%lf,%lf", &jx, &jy) != 2)
+				return "bad julia";
+			julia = 1;
+		} else {
+			return "unknown key";
+		}
+	}
+
+	j->params.julia = julia;
+	j->params.julia_cx = jx;
+	j->params.julia_cy = jy;
+	j->params.precision = 0;
+	if (deep_view(&j->params, &j->deep, width, height, cx, cy, r, max) < 0)
+		return "out of memory";
+	return NULL;
+}
+
+/*
+ * Read a line of at most len - 1 bytes, return its length or -1.
+ */
+static int read_request(int fd, char *buf, int len)
+{
+	int n = 0;
+	ssize_t r;
+
+	while (n < len - 1) {
+		r = read(fd, buf + n, 1);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		if (buf[n++] == '\n')
+			break;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+/*
+ * Serve one client: render its request with the pool,
+ * and write the image back as the rows complete.
+ */
+static void *serve(void *arg)
+{
+	int fd = (int)(long)arg;
+	char line[REQUEST_MAX], header[IMAGE_HEADER_MAX];
+	const char *err;
+	unsigned char *out;
+	struct job j;
+	size_t hlen, bpp, rowlen;
+	int r, ok = 1;
+
+	if (read_request(fd, line, sizeof(line)) < 0)
+		goto done;
+	if ((err = parse_request(&j, line)) != NULL)
+		goto error;
+
+	hlen = image_header(header, j.format, j.params.width, j.params.height, &bpp);
+	rowlen = j.params.width * bpp;
+	j.iter = malloc((size_t)j.params.width * j.params.height * sizeof(*j.iter));
+	j.ready = calloc(j.params.height, sizeof(*j.ready));
+	out = malloc(rowlen);
+	if (j.iter == NULL || j.ready == NULL || out == NULL) {
+		/* Only this client goes without */
+		if (j.params.deep != NULL)
+			deep_free(&j.deep);
+		free(j.iter);
+		free(j.ready);
+		free(out);
+		err = "out of memory";
+		goto error;
+	}
+	j.next_row = 0;
+	j.next = NULL;
+	pthread_cond_init(&j.row_done, NULL);
+
+	if (insist_write(fd, header, hlen) != hlen)
+		ok = 0;
+
+	pthread_mutex_lock(&pool_lock);
+	if (queue_tail != NULL)
+		queue_tail->next = &j;
+	else
+		queue_head = &j;
+	queue_tail = &j;
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+
+	/*
+	 * Stream the rows in order. If the client goes away,
+	 * keep waiting anyway: the pool is still working on j.
+	 */
+	for (r = 0; r < j.params.height; r++) {
+		pthread_mutex_lock(&pool_lock);
+		while (!j.ready[r])
+			pthread_cond_wait(&j.row_done, &pool_lock);
+		pthread_mutex_unlock(&pool_lock);
+
+		if (!ok)
+			continue;
+		image_encode(out, j.format, j.colors, j.params.max,
+			&j.iter[(size_t)r * j.params.width], j.params.width);
+		if (insist_write(fd, (char *)out, rowlen) != rowlen)
+			ok = 0;
+	}
+
+	pthread_cond_destroy(&j.row_done);
+	if (j.params.deep != NULL)
+		deep_free(&j.deep);
+	free(j.iter);
+	free(j.ready);
+	free(out);
+done:
+	close(fd);
+	return NULL;
+
+error:
+	snprintf(line, sizeof(line), "error: %s\n", err);
+	insist_write(fd, line, strlen(line));
+	close(fd);
+	return NULL;
+}
+
+/*
+ * Listen on the socket at path and serve renders with a pool
+ * of nworkers threads, forever. max is the iteration limit
+ * of requests that do not give one.
+ */
+void daemon_run(const char *path, int nworkers, int max)
+{
+	struct sockaddr_un addr;
+	pthread_t tid;
+	int sd, fd, i;
+
+	default_max = max;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "daemon_run: socket path too long\n");
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+
+	if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("daemon_run: socket");
+		exit(1);
+	}
+	unlink(path);
+	if (bind(sd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("daemon_run: bind");
+		exit(1);
+	}
+	if (listen(sd, 16) < 0) {
+		perror("daemon_run: listen");
+		exit(1);
+	}
+
+	/* A client that goes away must not kill the daemon */
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < nworkers; i++) {
+		if ((errno = pthread_create(&tid, NULL, pool_worker, NULL)) != 0) {
+			perror("daemon_run: pthread_create");
+			exit(1);
+		}
+		pthread_detach(tid);
+	}
+	fprintf(stderr, "Serving renders on %s with %d workers, kernel %s\n",
+		path, nworkers, mandel_kernel_name());
+
+	for (;;) {
+		if ((fd = accept(sd, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("daemon_run: accept");
+			exit(1);
+		}
+		/* If there is no thread for a client, it is turned away */
+		if ((errno = pthread_create(&tid, NULL, serve, (void *)(long)fd)) != 0) {
+			perror("daemon_run: pthread_create");
+			close(fd);
+			continue;
+		}
+		pthread_detach(tid);
+	}
+}
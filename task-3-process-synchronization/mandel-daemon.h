@@ -0,0 +1,22 @@
+/*
+ * mandel-daemon.h
+ *
+ * A render server on a Unix domain socket, with a pool of
+ * worker threads that is started once and kept warm.
+ *
+ */
+
+#ifndef MANDEL_DAEMON_H__
+#define MANDEL_DAEMON_H__
+
+/* Largest image a client may ask for, in either dimension and in pixels */
+#define DAEMON_MAX_SIZE 16384
+#define DAEMON_MAX_PIXELS (4096 * 4096)
+
+/* Largest iteration limit a client may ask for */
+#define DAEMON_MAX_ITER (1 << 24)
+
+/* Function prototypes */
+void daemon_run(const char *path, int nworkers, int max);
+
+#endif /* MANDEL_DAEMON_H__ */
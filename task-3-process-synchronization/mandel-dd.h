@@ -0,0 +1,121 @@
+/*
+ * mandel-dd.h
+ *
+ * Double-double arithmetic: a number is kept as the unevaluated
+ * sum of two doubles, hi + lo, with |lo| <= ulp(hi) / 2, for about
+ * 106 bits of mantissa. Enough to place a deep zoom reference point
+ * to ~1e-30, at a fraction of the cost of arbitrary precision.
+ *
+ * The algorithms are the classic error-free transformations of
+ * Knuth and Dekker, and rely on IEEE double rounding of every operation.
+ *
+ */
+
+#ifndef MANDEL_DD_H__
+#define MANDEL_DD_H__
+
+#include <math.h>
+
+typedef struct {
+	double hi;
+	double lo;
+} dd;
+
+/* a + b exactly, as hi + lo, given |a| >= |b| */
+static inline dd dd_quick_two_sum(double a, double b)
+{
+	dd r;
+
+	r.hi = a + b;
+	r.lo = b - (r.hi - a);
+	return r;
+}
+
+/* a + b exactly, as hi + lo */
+static inline dd dd_two_sum(double a, double b)
+{
+	dd r;
+	double v;
+
+	r.hi = a + b;
+	v = r.hi - a;
+	r.lo = (a - (r.hi - v)) + (b - v);
+	return r;
+}
+
+/* a * b exactly, as hi + lo */
+static inline dd dd_two_prod(double a, double b)
+{
+	dd r;
+
+	r.hi = a * b;
+	r.lo = fma(a, b, -r.hi);
+	return r;
+}
+
+static inline dd dd_from_double(double a)
+{
+	dd r = { a, 0.0 };
+
+	return r;
+}
+
+static inline dd dd_add(dd a, dd b)
+{
+	dd s, t;
+
+	s = dd_two_sum(a.hi, b.hi);
+	t = dd_two_sum(a.lo, b.lo);
+	s.lo += t.hi;
+	s = dd_quick_two_sum(s.hi, s.lo);
+	s.lo += t.lo;
+	return dd_quick_two_sum(s.hi, s.lo);
+}
+
+static inline dd dd_neg(dd a)
+{
+	a.hi = -a.hi;
+	a.lo = -a.lo;
+	return a;
+}
+
+static inline dd dd_sub(dd a, dd b)
+{
+	return dd_add(a, dd_neg(b));
+}
+
+static inline dd dd_mul(dd a, dd b)
+{
+	dd p;
+
+	p = dd_two_prod(a.hi, b.hi);
+	p.lo += a.hi * b.lo + a.lo * b.hi;
+	return dd_quick_two_sum(p.hi, p.lo);
+}
+
+static inline dd dd_mul_d(dd a, double b)
+{
+	dd p;
+
+	p = dd_two_prod(a.hi, b);
+	p.lo += a.lo * b;
+	return dd_quick_two_sum(p.hi, p.lo);
+}
+
+static inline dd dd_div_d(dd a, double b)
+{
+	dd p, r;
+	double q1, q2;
+
+	/* Long division: one correction step on the double quotient */
+	q1 = a.hi / b;
+	p = dd_two_prod(q1, b);
+	r = dd_sub(a, p);
+	q2 = (r.hi + r.lo) / b;
+	return dd_quick_two_sum(q1, q2);
+}
+
+/* Function prototypes */
+int dd_parse(const char *s, dd *val, char **end);
+
+#endif /* MANDEL_DD_H__ */
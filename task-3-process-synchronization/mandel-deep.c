@@ -0,0 +1,214 @@
+/*
+ * mandel-deep.c
+ *
+ * Deep zoom rendering of the Mandelbrot Set by perturbation.
+ *
+ * Past a zoom of about 1e-13, neighbouring pixels are no longer distinct
+ * doubles, and plain escape time iteration turns into blocks. Instead,
+ * the orbit Z_n of a single reference point C is computed once, in
+ * double-double precision. A pixel at C + dc then only tracks its
+ * difference dz_n from that orbit, z_n = Z_n + dz_n, which is small
+ * enough to keep in doubles:
+ *
+ *     dz_{n+1} = (2 Z_n + dz_n) dz_n + dc
+ *
+ * Where |z_n| gets smaller than |dz_n| the difference loses precision
+ * and the pixel would glitch. It is then rebased: dz_n becomes z_n and
+ * the pixel continues from the start of the reference orbit, Z_0 = 0.
+ * The same happens when the reference orbit runs out, because the
+ * reference point escaped before the pixel did.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "mandel-deep.h"
+
+/*
+ * Parse a decimal number, like strtod(), into double-double precision.
+ * Returns 0 on success, -1 if there is no number at s.
+ */
+int dd_parse(const char *s, dd *val, char **end)
+{
+	dd v = dd_from_double(0.0);
+	int neg = 0, digits = 0, exp = 0, e = 0, eneg = 0;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	if (*s == '-' || *s == '+')
+		neg = (*s++ == '-');
+
+	for (; isdigit((unsigned char)*s); s++, digits++)
+		v = dd_add(dd_mul_d(v, 10.0), dd_from_double(*s - '0'));
+	if (*s == '.')
+		for (s++; isdigit((unsigned char)*s); s++, digits++, exp--)
+			v = dd_add(dd_mul_d(v, 10.0), dd_from_double(*s - '0'));
+	if (digits == 0)
+		return -1;
+
+	if (*s == 'e' || *s == 'E') {
+		s++;
+		if (*s == '-' || *s == '+')
+			eneg = (*s++ == '-');
+		for (; isdigit((unsigned char)*s); s++)
+			e = 10 * e + (*s - '0');
+		exp += eneg ? -e : e;
+	}
+
+	for (; exp > 0; exp--)
+		v = dd_mul_d(v, 10.0);
+	for (; exp < 0; exp++)
+		v = dd_div_d(v, 10.0);
+
+	*val = neg ? dd_neg(v) : v;
+	if (end)
+		*end = (char *)s;
+	return 0;
+}
+
+/*
+ * Compute the reference orbit of (cx, cy), until it escapes
+ * or for max + 1 steps. Returns 0, or -1 with errno set if
+ * there is no memory for the orbit.
+ */
+int deep_reference(struct mandel_deep *d, dd cx, dd cy, int max)
+{
+	dd zx = dd_from_double(0.0), zy = dd_from_double(0.0), x2, y2;
+	int n;
+
+	d->cx = cx;
+	d->cy = cy;
+	d->max = max;
+	d->zx = malloc(((size_t)max + 2) * sizeof(*d->zx));
+	d->zy = malloc(((size_t)max + 2) * sizeof(*d->zy));
+	if (d->zx == NULL || d->zy == NULL) {
+		free(d->zx);
+		free(d->zy);
+		return -1;
+	}
+
+	d->zx[0] = d->zy[0] = 0.0;
+	for (n = 1; n <= max + 1; n++) {
+		x2 = dd_mul(zx, zx);
+		y2 = dd_mul(zy, zy);
+		zy = dd_add(dd_mul_d(dd_mul(zx, zy), 2.0), cy);
+		zx = dd_add(dd_sub(x2, y2), cx);
+		d->zx[n] = zx.hi;
+		d->zy[n] = zy.hi;
+		if (zx.hi * zx.hi + zy.hi * zy.hi > 4)
+			break;
+	}
+	d->len = (n <= max + 1) ? n : max + 1;
+	return 0;
+}
+
+void deep_free(struct mandel_deep *d)
+{
+	free(d->zx);
+	free(d->zy);
+}
+
+/*
+ * Set up p for a width x height render of the view centered at
+ * (cx, cy), with x from cx - r to cx + r and square pixels, with max
+ * iterations per point, of the set p->julia says, in the precision
+ * p->precision says, which the caller sets first. A precision of 0
+ * picks the cheapest one that resolves the pixel step. Views of the
+ * Mandelbrot Set in deep zoom precision get a reference orbit in d,
+ * to be freed when p->deep is not NULL.
+ * Returns 0, or -1 with errno set, as deep_reference().
+ */
+int deep_view(struct mandel_params *p, struct mandel_deep *d, int width, int height,
+	dd cx, dd cy, double r, int max)
+{
+	double mag;
+
+	p->width = width;
+	p->height = height;
+	p->xstep = p->ystep = 2 * r / width;
+	p->xmin = cx.hi - r;
+	p->ymax = cy.hi + p->ystep * height / 2;
+	p->max = max;
+	p->from = 0;
+	p->mirror = -1;
+	p->deep = NULL;
+
+	/* Orbits that matter stay within |z| <= 2 */
+	mag = fmax(fabs(cx.hi) + r, fabs(cy.hi) + p->ystep * height / 2);
+	if (!p->precision)
+		p->precision = mandel_precision_for(p->xstep, fmax(mag, 2.0), max);
+	if (p->precision != MANDEL_DEEP)
+		return 0;
+	if (p->julia) {
+		p->precision = MANDEL_DOUBLE;
+		return 0;
+	}
+
+	/* Offsets from the center of the view */
+	p->xmin = -r;
+	p->ymax = p->ystep * height / 2;
+	if (deep_reference(d, cx, cy, max) < 0)
+		return -1;
+	p->deep = d;
+	return 0;
+}
+
+/*
+ * Escape time of the point at (dx, dy) relative to the reference point,
+ * with the same result as mandel_iterations_at_point() would give
+ * if it had the precision.
+ */
+static int deep_iterations_at_point(const struct mandel_deep *d, double dcx, double dcy,
+	struct mandel_stats *st)
+{
+	double dzx = 0.0, dzy = 0.0, zx, zy, t, mag;
+	int n = 0, m = 0;
+
+	for (;;) {
+		/* dz = (2 Z_m + dz) dz + dc */
+		t = (2 * d->zx[m] + dzx) * dzx - (2 * d->zy[m] + dzy) * dzy + dcx;
+		dzy = (2 * d->zx[m] + dzx) * dzy + (2 * d->zy[m] + dzy) * dzx + dcy;
+		dzx = t;
+		m++;
+		n++;
+
+		/* z_n, where the plain kernel would be after n - 1 iterations */
+		zx = d->zx[m] + dzx;
+		zy = d->zy[m] + dzy;
+		mag = zx * zx + zy * zy;
+		if (mag > 4 || n > d->max)
+			break;
+
+		if (m == d->len || mag < dzx * dzx + dzy * dzy) {
+			/* Rebase onto the start of the reference orbit */
+			if (m != d->len)
+				st->rebases++;
+			dzx = zx;
+			dzy = zy;
+			m = 0;
+		}
+	}
+
+	st->points++;
+	st->iterations += n - 1;
+	return n - 1;
+}
+
+/*
+ * Compute the escape time for n points on a horizontal line, starting at
+ * (dx, dy) relative to the reference point and moving dxstep units to the right.
+ */
+void deep_iterations_line(const struct mandel_deep *d, double dx, double dxstep, double dy,
+	int n, int iter[], struct mandel_stats *st)
+{
+	struct mandel_stats ls = { 0 };
+	int i;
+
+	for (i = 0; i < n; i++)
+		iter[i] = deep_iterations_at_point(d, dx + i * dxstep, dy, &ls);
+
+	if (st)
+		mandel_stats_add(st, &ls);
+}
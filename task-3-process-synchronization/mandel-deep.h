@@ -0,0 +1,31 @@
+/*
+ * mandel-deep.h
+ *
+ * Deep zoom rendering of the Mandelbrot Set by perturbation:
+ * one reference orbit in double-double precision, and every pixel
+ * iterated in plain doubles as a small difference from it.
+ *
+ */
+
+#ifndef MANDEL_DEEP_H__
+#define MANDEL_DEEP_H__
+
+#include "mandel-dd.h"
+#include "mandel-lib.h"
+
+struct mandel_deep {
+	dd cx, cy;        /* the reference point, usually the center of the view */
+	int max;          /* maximum number of iterations */
+	int len;          /* the reference orbit has len + 1 points, Z_0 .. Z_len */
+	double *zx, *zy;  /* the reference orbit, rounded to double */
+};
+
+/* Function prototypes */
+int deep_reference(struct mandel_deep *d, dd cx, dd cy, int max);
+void deep_free(struct mandel_deep *d);
+int deep_view(struct mandel_params *p, struct mandel_deep *d, int width, int height,
+	dd cx, dd cy, double r, int max);
+void deep_iterations_line(const struct mandel_deep *d, double dx, double dxstep, double dy,
+	int n, int iter[], struct mandel_stats *st);
+
+#endif /* MANDEL_DEEP_H__ */
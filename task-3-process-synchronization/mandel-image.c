@@ -0,0 +1,168 @@
+/*
+ * mandel-image.c
+ *
+ * Image file output for the Mandelbrot Set.
+ *
+ * The output file is created at its final size and mapped MAP_SHARED
+ * before any workers are started. The mapping is inherited by forked
+ * children and shared by threads, so every worker writes its pixels
+ * straight into its own region of the file: no pipes, no copies,
+ * and no ordering between workers.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mandel-lib.h"
+#include "mandel-image.h"
+
+static const char *format_names[] = { "ppm", "pgm", "raw", NULL };
+
+/*
+ * Look up an output format by name, return -1 if unknown.
+ */
+int image_format(const char *name)
+{
+	int i;
+
+	for (i = 0; format_names[i] != NULL; i++)
+		if (strcmp(name, format_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+/*
+ * The name of a format, which is also the extension of its files.
+ */
+const char *image_format_name(int format)
+{
+	return format_names[format];
+}
+
+/*
+ * Write the file header of a width x height image into buf,
+ * which has room for IMAGE_HEADER_MAX bytes. Return its length,
+ * and set *bpp to the number of bytes per pixel.
+ */
+size_t image_header(char *buf, int format, int width, int height, size_t *bpp)
+{
+	switch (format) {
+	case IMAGE_PPM:
+		*bpp = 3;
+		return snprintf(buf, IMAGE_HEADER_MAX, "P6\n%d %d\n255\n", width, height);
+	case IMAGE_PGM:
+		*bpp = 1;
+		return snprintf(buf, IMAGE_HEADER_MAX, "P5\n%d %d\n255\n", width, height);
+	default:
+		*bpp = sizeof(uint32_t);
+		buf[0] = '\0';
+		return 0;
+	}
+}
+
+/*
+ * Encode the iteration counts of n pixels into p, in format,
+ * with palette colors by color mapping colors. max is the iteration
+ * count of points inside the set, which are drawn black in PGM.
+ */
+void image_encode(unsigned char *p, int format, int colors, int max, const int iter[], int n)
+{
+	const unsigned char *rgb;
+	uint32_t v;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		switch (format) {
+		case IMAGE_PPM:
+			rgb = rgb_color(mandel_color_index(colors, iter[i], max));
+			*p++ = rgb[0];
+			*p++ = rgb[1];
+			*p++ = rgb[2];
+			break;
+		case IMAGE_PGM:
+			*p++ = (iter[i] >= max) ? 0 : (iter[i] > 255) ? 255 : iter[i];
+			break;
+		default:
+			v = iter[i];
+			memcpy(p, &v, sizeof(v));
+			p += sizeof(v);
+			break;
+		}
+	}
+}
+
+/*
+ * Create the file at path, size it for a width x height image
+ * and map it into memory. colors is the color mapping of palette
+ * colors, max the iteration count of points inside the set.
+ * With keep, the pixels already in the file are kept.
+ */
+void image_open(struct mandel_image *img, const char *path, int format, int colors,
+	int width, int height, int max, int keep)
+{
+	char header[IMAGE_HEADER_MAX];
+
+	img->format = format;
+	img->colors = colors;
+	img->width = width;
+	img->height = height;
+	img->max = max;
+	img->header = image_header(header, format, width, height, &img->bpp);
+	img->size = img->header + (size_t)width * height * img->bpp;
+
+	img->fd = open(path, O_RDWR | O_CREAT | (keep ? 0 : O_TRUNC), 0644);
+	if (img->fd < 0) {
+		perror("image_open: open");
+		exit(1);
+	}
+	if (keep && lseek(img->fd, 0, SEEK_END) != (off_t)img->size) {
+		fprintf(stderr, "image_open: %s is not a %dx%d image to go on with\n",
+			path, width, height);
+		exit(1);
+	}
+	if (ftruncate(img->fd, img->size) < 0) {
+		perror("image_open: ftruncate");
+		exit(1);
+	}
+	img->map = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_SHARED, img->fd, 0);
+	if (img->map == MAP_FAILED) {
+		perror("image_open: mmap");
+		exit(1);
+	}
+	memcpy(img->map, header, img->header);
+}
+
+/*
+ * Store the iteration counts of n pixels of line,
+ * starting at column x, into the image.
+ */
+void image_store(struct mandel_image *img, int line, int x, const int iter[], int n)
+{
+	image_encode(img->map + img->header + ((size_t)line * img->width + x) * img->bpp,
+		img->format, img->colors, img->max, iter, n);
+}
+
+/*
+ * Flush the image to the file and unmap it.
+ */
+void image_close(struct mandel_image *img)
+{
+	if (msync(img->map, img->size, MS_SYNC) < 0) {
+		perror("image_close: msync");
+		exit(1);
+	}
+	if (munmap(img->map, img->size) < 0) {
+		perror("image_close: munmap");
+		exit(1);
+	}
+	if (close(img->fd) < 0) {
+		perror("image_close: close");
+		exit(1);
+	}
+}
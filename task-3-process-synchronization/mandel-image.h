@@ -0,0 +1,44 @@
+/*
+ * mandel-image.h
+ *
+ * Image file output for the Mandelbrot Set, through a shared
+ * memory mapping of the file that all workers write into directly.
+ *
+ */
+
+#ifndef MANDEL_IMAGE_H__
+#define MANDEL_IMAGE_H__
+
+#include <stddef.h>
+
+/* Output formats */
+#define IMAGE_PPM 0   /* binary PPM (P6), palette colors of a color mapping */
+#define IMAGE_PGM 1   /* binary PGM (P5), 8-bit gray */
+#define IMAGE_RAW 2   /* raw iteration counts, native 32-bit integers */
+
+/* Room for the longest file header */
+#define IMAGE_HEADER_MAX 64
+
+struct mandel_image {
+	int fd;
+	int format;
+	int width, height;
+	int colors;            /* color mapping, see mandel_color_index() */
+	int max;               /* iteration count of points inside the set */
+	size_t bpp;            /* bytes per pixel */
+	size_t header;         /* size of the file header */
+	size_t size;           /* size of the whole file */
+	unsigned char *map;    /* the file, mapped MAP_SHARED */
+};
+
+/* Function prototypes */
+int image_format(const char *name);
+const char *image_format_name(int format);
+size_t image_header(char *buf, int format, int width, int height, size_t *bpp);
+void image_encode(unsigned char *p, int format, int colors, int max, const int iter[], int n);
+void image_open(struct mandel_image *img, const char *path, int format, int colors,
+	int width, int height, int max, int keep);
+void image_store(struct mandel_image *img, int line, int x, const int iter[], int n);
+void image_close(struct mandel_image *img);
+
+#endif /* MANDEL_IMAGE_H__ */
@@ -0,0 +1,129 @@
+/*
+ * mandel-job.c
+ *
+ * Checkpointed image jobs.
+ *
+ * The bitmap file is image_path.done: the key of the job, padded to
+ * JOB_KEY_MAX bytes, then one bit per tile. It is mapped MAP_SHARED,
+ * like the image, before any workers are started, and a worker sets
+ * the bit of a tile once all of its pixels are stored. Both mappings
+ * are the page cache of the files, so whatever a worker stored before
+ * it died is still there for the next run, and every tile marked done
+ * is in the image. Tiles that were stored but not marked yet are just
+ * rendered again. The files only reach the disk at the latest on
+ * image_close(), though, so this covers dying processes, not machines.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mandel-job.h"
+
+/*
+ * Open the bitmap of the job on the image at image_path, with ntiles
+ * tiles. key describes everything the pixels depend on: a bitmap left
+ * by a job with another key is reset. Return the number of tiles
+ * already done; if 0, the image has to be created from scratch.
+ */
+int job_open(struct mandel_job *job, const char *image_path, const char *key, int ntiles)
+{
+	struct stat st;
+	int resume;
+
+	if (strlen(key) >= JOB_KEY_MAX) {
+		fprintf(stderr, "job_open: key too long\n");
+		exit(1);
+	}
+	if (snprintf(job->path, sizeof(job->path), "%s.done", image_path) >= (int)sizeof(job->path)) {
+		fprintf(stderr, "job_open: path too long\n");
+		exit(1);
+	}
+
+	job->ntiles = ntiles;
+	job->size = JOB_KEY_MAX + (ntiles + 7) / 8;
+	job->fd = open(job->path, O_RDWR | O_CREAT, 0644);
+	if (job->fd < 0) {
+		perror("job_open: open");
+		exit(1);
+	}
+	if (fstat(job->fd, &st) < 0) {
+		perror("job_open: fstat");
+		exit(1);
+	}
+	resume = ((size_t)st.st_size == job->size);
+	if (!resume && ftruncate(job->fd, job->size) < 0) {
+		perror("job_open: ftruncate");
+		exit(1);
+	}
+	job->map = mmap(NULL, job->size, PROT_READ | PROT_WRITE, MAP_SHARED, job->fd, 0);
+	if (job->map == MAP_FAILED) {
+		perror("job_open: mmap");
+		exit(1);
+	}
+	job->bits = job->map + JOB_KEY_MAX;
+
+	/* A bitmap of another job, or a new one: start from zero */
+	if (!resume || strncmp((char *)job->map, key, JOB_KEY_MAX) != 0) {
+		memset(job->map, 0, job->size);
+		strcpy((char *)job->map, key);
+		return 0;
+	}
+	return job_count(job);
+}
+
+/*
+ * Return whether tile is done.
+ */
+int job_done(const struct mandel_job *job, int tile)
+{
+	return (__atomic_load_n(&job->bits[tile / 8], __ATOMIC_ACQUIRE) >> (tile % 8)) & 1;
+}
+
+/*
+ * Mark tile as done, once all of its pixels are in the image.
+ * Workers mark tiles that share a byte at the same time.
+ */
+void job_mark(struct mandel_job *job, int tile)
+{
+	__atomic_fetch_or(&job->bits[tile / 8], 1 << (tile % 8), __ATOMIC_RELEASE);
+}
+
+/*
+ * Return the number of tiles done.
+ */
+int job_count(const struct mandel_job *job)
+{
+	int t, n = 0;
+
+	for (t = 0; t < job->ntiles; t++)
+		n += job_done(job, t);
+	return n;
+}
+
+/*
+ * Unmap the bitmap. Once every tile is done, the job is over
+ * and the bitmap file is removed.
+ */
+void job_close(struct mandel_job *job)
+{
+	int finished = (job_count(job) == job->ntiles);
+
+	if (munmap(job->map, job->size) < 0) {
+		perror("job_close: munmap");
+		exit(1);
+	}
+	if (close(job->fd) < 0) {
+		perror("job_close: close");
+		exit(1);
+	}
+	if (finished && unlink(job->path) < 0) {
+		perror("job_close: unlink");
+		exit(1);
+	}
+}
@@ -0,0 +1,34 @@
+/*
+ * mandel-job.h
+ *
+ * Checkpointed image jobs: which tiles of an image file are done
+ * is kept in a bitmap file next to it, so that a render that dies
+ * can be run again and go on where it stopped.
+ *
+ */
+
+#ifndef MANDEL_JOB_H__
+#define MANDEL_JOB_H__
+
+#include <stddef.h>
+
+/* Room for the key of a job, the header of the bitmap file */
+#define JOB_KEY_MAX 256
+
+struct mandel_job {
+	int fd;
+	int ntiles;
+	char path[4096];       /* the bitmap file */
+	size_t size;           /* size of the bitmap file */
+	unsigned char *map;    /* the bitmap file, mapped MAP_SHARED */
+	unsigned char *bits;   /* tile t is done if bit t % 8 of bits[t / 8] is set */
+};
+
+/* Function prototypes */
+int job_open(struct mandel_job *job, const char *image_path, const char *key, int ntiles);
+int job_done(const struct mandel_job *job, int tile);
+void job_mark(struct mandel_job *job, int tile);
+int job_count(const struct mandel_job *job);
+void job_close(struct mandel_job *job);
+
+#endif /* MANDEL_JOB_H__ */
@@ -21,6 +21,13 @@
  *                                       *
  *****************************************/
 
+/*
+ * The conversion from RGB to the nearest xterm color is slow,
+ * so it and the palette below are only compiled into mandel-xterm-gen,
+ * which runs at build time and writes the table used by xterm_color().
+ */
+#ifdef MANDEL_XTERM_TABLE_GEN
+
 /* 3 functions to convert between RGB colors and the corresponding xterm-256 values
  * Wolfgang Frisch, xororand@frexx.de */
 
@@ -91,6 +98,7 @@ static void maketable()
 		colortable[c][1] = rgb[1];
 		colortable[c][2] = rgb[2];
 	}
+	initialized = 1;
 }
 
 // selects the nearest xterm color for a 3xBYTE rgb value
@@ -386,26 +394,84 @@ static struct { double red; double green; double blue; } mandel256[] = {
 	{0.000,0.000,0.000}
 };
 
+#endif /* MANDEL_XTERM_TABLE_GEN */
+
 /*******************************************
  *                                         *
  * Functions to compute the Mandelbrot set *
  *                                         *
  *******************************************/
 
+/*
+ * Points inside the main cardioid or the period-2 bulb never escape,
+ * and can be recognized analytically without iterating at all.
+ * Returns MANDEL_CARDIOID, MANDEL_BULB or 0.
+ */
+int mandel_interior_shortcut(double x, double y)
+{
+	double q, xq = x - 0.25, y2 = y * y;
+
+	q = xq * xq + y2;
+	if (q * (q + xq) <= 0.25 * y2)
+		return MANDEL_CARDIOID;
+	if ((x + 1) * (x + 1) + y2 <= 0.0625)
+		return MANDEL_BULB;
+	return 0;
+}
+
 /*
  * This function takes a (x,y) point on the complex plane
  * and uses the escape time algorithm to return a color value
  * used to draw the Mandelbrot Set.
+ *
+ * Points that are proven to be inside the set, either analytically
+ * or because their orbit falls into a cycle, return max early.
+ * The cycle check follows Brent: z is compared against a snapshot
+ * taken at iterations 1, 2, 4, 8, ..., so a cycle of any period
+ * is caught once the snapshot interval exceeds it.
+ *
+ * If st is not NULL, the work done and the shortcuts taken
+ * are added to it.
  */
-int mandel_iterations_at_point(double x, double y, int max)
+int mandel_iterations_at_point_stats(double x, double y, int max, struct mandel_stats *st)
 {
 	double x0 = x;
 	double y0 = y;
-	int iter = 0;
+	double sx = NAN, sy = NAN;
+	int iter = 0, snap = 1;
+	int shortcut;
+
+	if ((shortcut = mandel_interior_shortcut(x0, y0)) != 0) {
+		if (st) {
+			st->points++;
+			if (shortcut == MANDEL_CARDIOID)
+				st->cardioid++;
+			else
+				st->bulb++;
+		}
+		return max;
+	}
 
 	while ( (x * x + y * y <= 4) && iter < max) {
-		double xt = x * x - y * y + x0;
-		double yt = 2 * x * y + y0;
+		double xt, yt;
+
+		if (x == sx && y == sy) {
+			/* Periodic orbit, the point is inside */
+			if (st) {
+				st->points++;
+				st->iterations += iter;
+				st->cycles++;
+			}
+			return max;
+		}
+		if (iter == snap) {
+			sx = x;
+			sy = y;
+			snap += snap;
+		}
+
+		xt = x * x - y * y + x0;
+		yt = 2 * x * y + y0;
 
 		x = xt;
 		y = yt;
@@ -413,9 +479,43 @@ int mandel_iterations_at_point(double x, double y, int max)
 		++iter;
 	}
 
+	if (st) {
+		st->points++;
+		st->iterations += iter;
+	}
+
 	return iter;
 }
 
+int mandel_iterations_at_point(double x, double y, int max)
+{
+	return mandel_iterations_at_point_stats(x, y, max, NULL);
+}
+
+/*
+ * Add the counters of b to a.
+ */
+void mandel_stats_add(struct mandel_stats *a, const struct mandel_stats *b)
+{
+	a->points += b->points;
+	a->iterations += b->iterations;
+	a->cardioid += b->cardioid;
+	a->bulb += b->bulb;
+	a->cycles += b->cycles;
+	a->filled += b->filled;
+	a->mirrored += b->mirrored;
+	a->rebases += b->rebases;
+}
+
+#ifndef MANDEL_XTERM_TABLE_GEN
+
+/*
+ * mandel_xterm[] maps every entry of the palette above to its
+ * nearest xterm color, mandel_rgb[] has the entries as 8-bit RGB.
+ * Both are generated at build time, see below.
+ */
+#include "mandel-xterm-table.h"
+
 /*
  * This function takes a color value as returned
  * by mandelbrot_iterations() and uses the 256-color
@@ -424,18 +524,62 @@ int mandel_iterations_at_point(double x, double y, int max)
  */
 unsigned char xterm_color(int color_val)
 {
-	unsigned char rgb[3];
+	if (color_val > 255)
+		color_val = 255;
 
+	return mandel_xterm[color_val];
+}
+
+/*
+ * The same, returning the 8-bit RGB palette entry itself,
+ * for output that is not limited to 256 colors.
+ */
+const unsigned char *rgb_color(int color_val)
+{
 	if (color_val > 255)
 		color_val = 255;
 
-	rgb[0] = 255.0 * mandel256[color_val].red;
-	rgb[1] = 255.0 * mandel256[color_val].green;
-	rgb[2] = 255.0 * mandel256[color_val].blue;
-	color_val = rgb2xterm(rgb);
-	
-	assert(0 <= color_val && color_val <= 255);
-	return color_val;
+	return mandel_rgb[color_val];
+}
+
+#endif /* !MANDEL_XTERM_TABLE_GEN */
+
+static const char *color_map_names[] = { "clamp", "cycle", "log", NULL };
+
+/*
+ * Look up a color mapping by name, return -1 if unknown.
+ */
+int mandel_color_map(const char *name)
+{
+	int i;
+
+	for (i = 0; color_map_names[i] != NULL; i++)
+		if (strcmp(name, color_map_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+const char *mandel_color_map_name(int map)
+{
+	return (map >= 0 && map < MANDEL_COLOR_MAPS) ? color_map_names[map] : "unknown";
+}
+
+/*
+ * The palette entry for a point with iteration count iter, with
+ * color mapping map, where points still bounded after max iterations
+ * are inside the set. It only looks at the count, so a render whose
+ * counts are kept can be colored again without computing any point.
+ */
+int mandel_color_index(int map, int iter, int max)
+{
+	switch (map) {
+	case MANDEL_COLOR_CYCLE:
+		return (iter >= max) ? 255 : iter % 255;
+	case MANDEL_COLOR_LOG:
+		return (iter >= max) ? 255 : (int)(254 * log1p(iter) / log1p(max));
+	default:
+		return (iter > 255) ? 255 : iter;
+	}
 }
 
 /*
@@ -484,3 +628,74 @@ void reset_xterm_color(int fd)
 		exit(1);
 	}
 }
+
+/*
+ * Encode a line of n points, drawn as '@' in the given colors,
+ * followed by a newline, into buf. The color escape is only emitted
+ * when the color changes from the previous point, so a run of points
+ * of the same color costs one byte per point.
+ *
+ * buf must have room for XTERM_LINE_MAX(n) bytes.
+ * Returns the number of bytes used.
+ */
+size_t xterm_encode_line(char *buf, const int color_val[], int n)
+{
+	char *p = buf;
+	int i, c, prev = -1;
+
+	for (i = 0; i < n; i++) {
+		c = color_val[i];
+		if (c != prev) {
+			/* "\033[38;5;%dm", without the cost of snprintf() */
+			memcpy(p, "\033[38;5;", 7);
+			p += 7;
+			if (c >= 100)
+				*p++ = '0' + c / 100;
+			if (c >= 10)
+				*p++ = '0' + (c / 10) % 10;
+			*p++ = '0' + c % 10;
+			*p++ = 'm';
+			prev = c;
+		}
+		*p++ = '@';
+	}
+	*p++ = '\n';
+
+	return p - buf;
+}
+
+#ifdef MANDEL_XTERM_TABLE_GEN
+
+/*
+ * Build-time generator for mandel-xterm-table.h:
+ * print the nearest xterm color for every entry of mandel256[],
+ * and the entries themselves as 8-bit RGB.
+ */
+int main(void)
+{
+	int i;
+	unsigned char rgb[3];
+
+	printf("/* Generated by mandel-xterm-gen, do not edit */\n\n");
+	printf("static const unsigned char mandel_xterm[256] = {");
+	for (i = 0; i < 256; i++) {
+		rgb[0] = 255.0 * mandel256[i].red;
+		rgb[1] = 255.0 * mandel256[i].green;
+		rgb[2] = 255.0 * mandel256[i].blue;
+		printf("%s%3d,", (i % 12) ? " " : "\n\t", rgb2xterm(rgb));
+	}
+	printf("\n};\n\n");
+
+	printf("static const unsigned char mandel_rgb[256][3] = {");
+	for (i = 0; i < 256; i++) {
+		rgb[0] = 255.0 * mandel256[i].red;
+		rgb[1] = 255.0 * mandel256[i].green;
+		rgb[2] = 255.0 * mandel256[i].blue;
+		printf("%s{ %3d, %3d, %3d },", (i % 4) ? " " : "\n\t", rgb[0], rgb[1], rgb[2]);
+	}
+	printf("\n};\n");
+
+	return 0;
+}
+
+#endif /* MANDEL_XTERM_TABLE_GEN */
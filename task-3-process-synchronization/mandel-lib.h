@@ -9,11 +9,118 @@
 #ifndef MANDEL_LIB_H__
 #define MANDEL_LIB_H__
 
+#include <sys/types.h>
+
+/* Return values of mandel_interior_shortcut() */
+#define MANDEL_CARDIOID 1
+#define MANDEL_BULB     2
+
+/*
+ * Arithmetic used for a view, see mandel_precision_for().
+ * The pixel step must be at least MANDEL_PRECISION_MARGIN times
+ * the rounding unit of the coordinates, to leave room for the
+ * error that builds up while iterating.
+ */
+#define MANDEL_FLOAT    1
+#define MANDEL_DOUBLE   2
+#define MANDEL_DEEP     3
+#define MANDEL_PRECISION_MARGIN 4096.0
+#define MANDEL_FLOAT_MAX_ITER   (1 << 24)
+
+/*
+ * However fine the pixel step, float rounding changes the counts of
+ * more and more points near the boundary as their orbits run longer:
+ * about 1 in 6000 of the default view at 64 iterations, 1 in 220 at
+ * 100000. Past this limit, auto picks double instead.
+ */
+#define MANDEL_FLOAT_AUTO_ITER  64
+
+/*
+ * How iteration counts map to the 256 entries of the palette,
+ * see mandel_color_index(). The last entry is black, for the
+ * points inside the set.
+ */
+#define MANDEL_COLOR_CLAMP  0   /* the count, up to 255 */
+#define MANDEL_COLOR_CYCLE  1   /* the count modulo 255, for deep views */
+#define MANDEL_COLOR_LOG    2   /* the log of the count, spread over the palette up to max */
+#define MANDEL_COLOR_MAPS   3
+
+/*
+ * Per-render counters, to see how much work the
+ * interior shortcuts save.
+ */
+struct mandel_stats {
+	unsigned long points;      /* points computed */
+	unsigned long iterations;  /* z -> z^2 + c steps actually taken */
+	unsigned long cardioid;    /* points found inside the main cardioid */
+	unsigned long bulb;        /* points found inside the period-2 bulb */
+	unsigned long cycles;      /* points whose orbit fell into a cycle */
+	unsigned long filled;      /* points filled in by area rendering, not computed */
+	unsigned long mirrored;    /* points copied from their mirror image, not computed */
+	unsigned long rebases;     /* deep zoom glitches avoided by rebasing */
+};
+
+/*
+ * What to render, see mandel_render(). Renders share nothing else,
+ * so any number of them can run at the same time, in threads of
+ * the same process.
+ *
+ * Point i of row r is at x = xmin + i * xstep, y = ymax - r * ystep.
+ * If mirror is not -1, y = (mirror / 2 - r) * ystep instead, the same
+ * up to rounding, but rows r and mirror - r are at exactly -y and y.
+ * With MANDEL_DEEP these are offsets from the reference point of deep,
+ * see mandel-deep.h, which only works for the Mandelbrot Set.
+ */
+struct mandel_deep;
+
+struct mandel_params {
+	int width, height;         /* points per row, and rows */
+	double xmin, ymax;         /* the upper left point */
+	double xstep, ystep;       /* distance between neighbouring points */
+	int max;                   /* points still bounded after max iterations are inside */
+	int from;                  /* resume saved orbits that stopped at from < max, or 0 */
+	int mirror;                /* rows mirror - r and r are at opposite y, or -1 */
+	int precision;             /* MANDEL_FLOAT, MANDEL_DOUBLE or MANDEL_DEEP */
+	int julia;                 /* draw the Julia set for c = julia_cx + i julia_cy */
+	double julia_cx, julia_cy;
+	const struct mandel_deep *deep;  /* the reference orbit, for MANDEL_DEEP */
+};
+
+/*
+ * Worst case size of a line encoded by xterm_encode_line():
+ * a full color escape before every point, and a newline.
+ */
+#define XTERM_LINE_MAX(n) ((n) * sizeof("\033[38;5;255m@") + 1)
+
 /* Function prototypes */
+int mandel_interior_shortcut(double x, double y);
 int mandel_iterations_at_point(double x, double y, int max);
+int mandel_iterations_at_point_stats(double x, double y, int max, struct mandel_stats *st);
+void mandel_stats_add(struct mandel_stats *a, const struct mandel_stats *b);
+void mandel_iterations_line(const struct mandel_params *p, double x, double y, int n, int iter[],
+	double zx[], double zy[], struct mandel_stats *st);
+int mandel_set_kernel(const char *name);
+const char *mandel_kernel_name(void);
+const char *mandel_kernel_list(int i);
+int mandel_precision_for(double step, double mag, int max);
+const char *mandel_precision_name(int prec);
+void mandel_params_init(struct mandel_params *p, int width, int height,
+	double xmin, double xmax, double ymin, double ymax, int max);
+void mandel_render_span(const struct mandel_params *p, int row, int x, int n, int iter[],
+	struct mandel_stats *st);
+void mandel_render_span_orbits(const struct mandel_params *p, int row, int x, int n, int iter[],
+	double zx[], double zy[], struct mandel_stats *st);
+void mandel_render_rows(const struct mandel_params *p, int first, int count, int iter[],
+	struct mandel_stats *st);
+void mandel_render(const struct mandel_params *p, int iter[], struct mandel_stats *st);
+int mandel_color_map(const char *name);
+const char *mandel_color_map_name(int map);
+int mandel_color_index(int map, int iter, int max);
 unsigned char xterm_color(int color_val);
+const unsigned char *rgb_color(int color_val);
 ssize_t insist_write(int fd, const char *buf, size_t count);
 void set_xterm_color(int fd, unsigned char color);
 void reset_xterm_color(int fd);
+size_t xterm_encode_line(char *buf, const int color_val[], int n);
 
 #endif /* MANDEL_LIB_H__ */
@@ -0,0 +1,99 @@
+/*
+ * mandel-orbits.c
+ *
+ * Saved orbits of an image file.
+ *
+ * The orbits file is image_path.orbits: the key of the view, padded to
+ * ORBITS_KEY_MAX bytes, the iteration limit the orbits were saved with,
+ * then zx[], zy[] and the counts of all points, in the order of the
+ * image. It is mapped MAP_SHARED before any workers are started, like
+ * the bitmap of a job, and the workers go on from and store to it
+ * in place. So while they do, the orbits are a mix of old and new
+ * ones: the limit is 0 then, and only set on orbits_close(), once
+ * every point is done.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mandel-orbits.h"
+
+/* The key and the limit, with the orbits after them aligned for doubles */
+#define ORBITS_HEADER (ORBITS_KEY_MAX + sizeof(double))
+
+/*
+ * Open the orbits of the image at image_path, with npoints points.
+ * key describes everything but the limit that the counts depend on:
+ * orbits left with another key are not used. Return the limit of
+ * the saved orbits, to go on from, or 0 if there are none.
+ */
+int orbits_open(struct mandel_orbits *o, const char *image_path, const char *key, int npoints)
+{
+	struct stat st;
+	int max;
+
+	if (strlen(key) >= ORBITS_KEY_MAX) {
+		fprintf(stderr, "orbits_open: key too long\n");
+		exit(1);
+	}
+	if (snprintf(o->path, sizeof(o->path), "%s.orbits", image_path) >= (int)sizeof(o->path)) {
+		fprintf(stderr, "orbits_open: path too long\n");
+		exit(1);
+	}
+
+	o->size = ORBITS_HEADER + (size_t)npoints * (2 * sizeof(double) + sizeof(int));
+	o->fd = open(o->path, O_RDWR | O_CREAT, 0644);
+	if (o->fd < 0) {
+		perror("orbits_open: open");
+		exit(1);
+	}
+	if (fstat(o->fd, &st) < 0) {
+		perror("orbits_open: fstat");
+		exit(1);
+	}
+	if ((size_t)st.st_size != o->size && ftruncate(o->fd, o->size) < 0) {
+		perror("orbits_open: ftruncate");
+		exit(1);
+	}
+	o->map = mmap(NULL, o->size, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd, 0);
+	if (o->map == MAP_FAILED) {
+		perror("orbits_open: mmap");
+		exit(1);
+	}
+	o->max = (int *)(o->map + ORBITS_KEY_MAX);
+	o->zx = (double *)(o->map + ORBITS_HEADER);
+	o->zy = o->zx + npoints;
+	o->iter = (int *)(o->zy + npoints);
+
+	/* Orbits of another view, or of a render that did not finish */
+	max = *o->max;
+	if ((size_t)st.st_size != o->size || strncmp((char *)o->map, key, ORBITS_KEY_MAX) != 0)
+		max = 0;
+
+	memset(o->map, 0, ORBITS_HEADER);
+	strcpy((char *)o->map, key);
+	return max;
+}
+
+/*
+ * Unmap the orbits. If every point was stored with limit max, record
+ * it for the next render to go on from, else pass 0.
+ */
+void orbits_close(struct mandel_orbits *o, int max)
+{
+	*o->max = max;
+	if (munmap(o->map, o->size) < 0) {
+		perror("orbits_close: munmap");
+		exit(1);
+	}
+	if (close(o->fd) < 0) {
+		perror("orbits_close: close");
+		exit(1);
+	}
+}
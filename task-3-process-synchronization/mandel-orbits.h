@@ -0,0 +1,33 @@
+/*
+ * mandel-orbits.h
+ *
+ * Saved orbits of an image file: the count and the z every point
+ * stopped at are kept in a file next to it, so that rendering the
+ * same view again with more iterations only goes on with the points
+ * that ran out of them.
+ *
+ */
+
+#ifndef MANDEL_ORBITS_H__
+#define MANDEL_ORBITS_H__
+
+#include <stddef.h>
+
+/* Room for the key of the orbits, the header of the file */
+#define ORBITS_KEY_MAX 256
+
+struct mandel_orbits {
+	int fd;
+	char path[4096];       /* the orbits file */
+	size_t size;           /* size of the orbits file */
+	unsigned char *map;    /* the orbits file, mapped MAP_SHARED */
+	int *max;              /* the iteration limit of the saved orbits, or 0 */
+	double *zx, *zy;       /* the z every point stopped at, see mandel_render_span_orbits() */
+	int *iter;             /* the count of every point */
+};
+
+/* Function prototypes */
+int orbits_open(struct mandel_orbits *o, const char *image_path, const char *key, int npoints);
+void orbits_close(struct mandel_orbits *o, int max);
+
+#endif /* MANDEL_ORBITS_H__ */
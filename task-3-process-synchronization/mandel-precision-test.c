@@ -0,0 +1,56 @@
+/*
+ * mandel-precision-test.c
+ *
+ * A program to verify that the automatic choice of arithmetic only
+ * picks float where it gives (nearly) the same counts as double: the
+ * default view is rendered in both with a range of iteration limits,
+ * and wherever mandel_precision_for() picks float, at most 1 in
+ * TOLERANCE points may differ. This is done with every kernel the
+ * machine supports.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandel-lib.h"
+
+#define WIDTH     800
+#define HEIGHT    600
+#define TOLERANCE 2048
+
+static int single[WIDTH * HEIGHT], twice[WIDTH * HEIGHT];
+
+int main(void)
+{
+	static const int limits[] = { 16, 32, MANDEL_FLOAT_AUTO_ITER, 256, 100000 };
+	struct mandel_params p;
+	const char *kernel;
+	int i, k, l, bad, ret = 0;
+
+	for (k = 0; (kernel = mandel_kernel_list(k)) != NULL; k++) {
+		mandel_set_kernel(kernel);
+		for (l = 0; l < (int)(sizeof(limits) / sizeof(limits[0])); l++) {
+			mandel_params_init(&p, WIDTH, HEIGHT, -1.8, 1.0, -1.0, 1.0, limits[l]);
+			if (p.precision != MANDEL_FLOAT) {
+				printf("Kernel %s, %d iterations: auto picks %s\n", kernel,
+					limits[l], mandel_precision_name(p.precision));
+				continue;
+			}
+
+			mandel_render(&p, single, NULL);
+			p.precision = MANDEL_DOUBLE;
+			mandel_render(&p, twice, NULL);
+
+			bad = 0;
+			for (i = 0; i < WIDTH * HEIGHT; i++)
+				bad += (single[i] != twice[i]);
+			printf("Kernel %s, %d iterations: auto picks float, %d points differ from double\n",
+				kernel, limits[l], bad);
+			if (bad > WIDTH * HEIGHT / TOLERANCE)
+				ret = 1;
+		}
+	}
+	return ret;
+}
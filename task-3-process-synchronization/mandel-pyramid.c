@@ -0,0 +1,380 @@
+/*
+ * mandel-pyramid.c
+ *
+ * Tile pyramids. Level 0 is a single tile of the square view with
+ * center (cx, cy) and half width r, and every tile of a level is split
+ * into four tiles of the next one, so tile x, y of level z, counted
+ * from the upper left, covers 1 / 2^z of the view either way. Tiles go
+ * to path/z/x/y.ppm (or .pgm, .raw), or, for a path ending in .tar,
+ * into a single tar archive under the same names.
+ *
+ * The pool renders one level at a time, with a barrier in between,
+ * because a tile may reuse its parent:
+ *
+ * The points that take at least k iterations, L_k = { c : |z_k(c)| <= 2 },
+ * form a connected set without holes, like the Mandelbrot Set itself.
+ * So if the border of a rectangle takes exactly k iterations everywhere,
+ * all of the inside takes at least k, and more only if L_k+1 is inside
+ * without touching the border: all of it, with c = 0, which rectangles
+ * without 0 do not have. For k = max there is no L_k+1. So a tile whose
+ * pixels all have the same count, and whose border has it too, sampled
+ * at the pixel step of the deepest level, is uniform at every level
+ * below, and its descendants are filled without iterating. This is the
+ * reasoning of Mariani-Silver rendering, up to the sampling of the
+ * border, but with the border sampled as finely as any pixel inside.
+ *
+ * Tiles too deep for double precision are rendered by perturbation,
+ * around a reference orbit at the center of each tile, as with -Z.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "mandel-lib.h"
+#include "mandel-dd.h"
+#include "mandel-deep.h"
+#include "mandel-image.h"
+#include "mandel-pyramid.h"
+
+#define TAR_BLOCK 512
+#define TAR_NAME_MAX 100
+
+/* What to render, and where to */
+static const char *pyr_path;
+static int pyr_levels, pyr_format, pyr_colors, pyr_max;
+static int pyr_precision;                /* of every tile, or 0 for the cheapest one */
+static dd pyr_cx, pyr_cy;                /* center and half width of level 0 */
+static double pyr_r;
+static int pyr_tar = -1;                 /* the archive, or -1 for a directory */
+static time_t pyr_mtime;
+
+/*
+ * For every level but the deepest, the count of each tile
+ * proven uniform, or -1, for the level below to fill in.
+ */
+static int *uniform[PYRAMID_MAX_LEVEL];
+
+static int next_tile[PYRAMID_MAX_LEVEL + 1];
+static int tiles_filled, tiles_proven;
+static pthread_barrier_t level_done;
+static pthread_mutex_t tar_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Set up p for tile x, y of level z, with size x size pixels, and
+ * the reference orbit in d if it needs one, to be freed when p->deep
+ * is not NULL.
+ */
+static void tile_params(struct mandel_params *p, struct mandel_deep *d, int z, int x, int y,
+	int size)
+{
+	double w = 2 * pyr_r / (1 << z);
+	dd cx = dd_add(pyr_cx, dd_from_double((x + 0.5) * w - pyr_r));
+	dd cy = dd_add(pyr_cy, dd_from_double(pyr_r - (y + 0.5) * w));
+
+	p->julia = 0;
+	p->precision = pyr_precision;
+	if (deep_view(p, d, size, size, cx, cy, w / 2, pyr_max) < 0) {
+		perror("tile_params: deep_view");
+		exit(1);
+	}
+}
+
+/*
+ * Return the count of tile x, y of level z, whose pixels are in iter[],
+ * if it is proven uniform down to the deepest level, else -1.
+ */
+static int prove_uniform(int z, int x, int y, const int iter[], struct mandel_stats *st)
+{
+	struct mandel_params p;
+	struct mandel_deep d;
+	double w = 2 * pyr_r / (1 << z);
+	double xmin = pyr_cx.hi - pyr_r + x * w, ymax = pyr_cy.hi + pyr_r - y * w;
+	int n = PYRAMID_TILE << (pyr_levels - z);
+	int buf[PYRAMID_TILE];
+	int v = iter[0], i, r, c;
+
+	for (i = 1; i < PYRAMID_TILE * PYRAMID_TILE; i++)
+		if (iter[i] != v)
+			return -1;
+	if (v < pyr_max && xmin <= 0 && xmin + w >= 0 && ymax >= 0 && ymax - w <= 0)
+		return -1;
+
+	/* The border at the pixel step of the deepest level */
+	tile_params(&p, &d, z, x, y, n);
+	for (r = 0; r < n && v >= 0; r += n - 1) {
+		for (c = 0; c < n && v >= 0; c += PYRAMID_TILE) {
+			mandel_render_span(&p, r, c, PYRAMID_TILE, buf, st);
+			for (i = 0; i < PYRAMID_TILE; i++)
+				if (buf[i] != v)
+					v = -1;
+		}
+	}
+	for (r = 1; r < n - 1 && v >= 0; r++) {
+		mandel_render_span(&p, r, 0, 1, &buf[0], st);
+		mandel_render_span(&p, r, n - 1, 1, &buf[1], st);
+		if (buf[0] != v || buf[1] != v)
+			v = -1;
+	}
+
+	if (p.deep != NULL)
+		deep_free(&d);
+	return v;
+}
+
+/*
+ * Append a file of size bytes to the archive: a ustar header block,
+ * then the data, padded to whole blocks. name is shorter than
+ * TAR_NAME_MAX bytes.
+ */
+static void tar_add(const char *name, const unsigned char *data, size_t size)
+{
+	static const char zero[TAR_BLOCK];
+	char block[TAR_BLOCK];
+	size_t pad = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+	unsigned int sum = 0;
+	int i;
+
+	memset(block, 0, sizeof(block));
+	strcpy(block, name);                                       /* name */
+	sprintf(block + 100, "%07o", 0644);                        /* mode */
+	sprintf(block + 108, "%07o", 0);                           /* uid */
+	sprintf(block + 116, "%07o", 0);                           /* gid */
+	sprintf(block + 124, "%011lo", (unsigned long)size);
+	sprintf(block + 136, "%011lo", (unsigned long)pyr_mtime);
+	block[156] = '0';                                          /* a regular file */
+	memcpy(block + 257, "ustar", 6);
+	memcpy(block + 263, "00", 2);
+
+	/* The checksum counts its own field as spaces */
+	memset(block + 148, ' ', 8);
+	for (i = 0; i < TAR_BLOCK; i++)
+		sum += (unsigned char)block[i];
+	sprintf(block + 148, "%06o", sum);
+
+	pthread_mutex_lock(&tar_lock);
+	if (insist_write(pyr_tar, block, TAR_BLOCK) != TAR_BLOCK ||
+	    insist_write(pyr_tar, (const char *)data, size) != size ||
+	    insist_write(pyr_tar, zero, pad) != pad) {
+		perror("tar_add: write");
+		exit(1);
+	}
+	pthread_mutex_unlock(&tar_lock);
+}
+
+/*
+ * Encode the counts of tile x, y of level z into out, which has room
+ * for the whole file, and write it out.
+ */
+static void write_tile(int z, int x, int y, const int iter[], unsigned char *out)
+{
+	char header[IMAGE_HEADER_MAX], name[4096];
+	size_t hlen, bpp, rowlen, size;
+	int r, fd;
+
+	hlen = image_header(header, pyr_format, PYRAMID_TILE, PYRAMID_TILE, &bpp);
+	rowlen = PYRAMID_TILE * bpp;
+	size = hlen + rowlen * PYRAMID_TILE;
+	memcpy(out, header, hlen);
+	for (r = 0; r < PYRAMID_TILE; r++)
+		image_encode(out + hlen + r * rowlen, pyr_format, pyr_colors, pyr_max,
+			&iter[r * PYRAMID_TILE], PYRAMID_TILE);
+
+	if (pyr_tar >= 0) {
+		char member[TAR_NAME_MAX];
+
+		snprintf(member, sizeof(member), "%d/%d/%d.%s", z, x, y, image_format_name(pyr_format));
+		tar_add(member, out, size);
+		return;
+	}
+
+	snprintf(name, sizeof(name), "%s/%d/%d/%d.%s", pyr_path, z, x, y,
+		image_format_name(pyr_format));
+	if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror("write_tile: open");
+		exit(1);
+	}
+	if (insist_write(fd, (char *)out, size) != size || close(fd) < 0) {
+		perror("write_tile: write");
+		exit(1);
+	}
+}
+
+/*
+ * Render tile x, y of level z, or fill it in if its parent is uniform,
+ * and write it out. iter[] and out are the buffers of the worker.
+ */
+static void pyramid_tile(int z, int x, int y, int iter[], unsigned char *out,
+	struct mandel_stats *st)
+{
+	struct mandel_params p;
+	struct mandel_deep d;
+	int n = 1 << z, v = -1, i;
+
+	if (z > 0)
+		v = uniform[z - 1][(y / 2) * (n / 2) + x / 2];
+
+	if (v >= 0) {
+		for (i = 0; i < PYRAMID_TILE * PYRAMID_TILE; i++)
+			iter[i] = v;
+		st->filled += PYRAMID_TILE * PYRAMID_TILE;
+		__sync_fetch_and_add(&tiles_filled, 1);
+	} else {
+		tile_params(&p, &d, z, x, y, PYRAMID_TILE);
+		mandel_render(&p, iter, st);
+		if (p.deep != NULL)
+			deep_free(&d);
+		if (z < pyr_levels && (v = prove_uniform(z, x, y, iter, st)) >= 0)
+			__sync_fetch_and_add(&tiles_proven, 1);
+	}
+
+	if (z < pyr_levels)
+		uniform[z][y * n + x] = v;
+	write_tile(z, x, y, iter, out);
+}
+
+/*
+ * A worker of the pool: tiles of a level from the shared counter,
+ * then wait for the others before going on to the next level.
+ */
+static void *pyramid_worker(void *arg)
+{
+	struct mandel_stats *st = arg;
+	int *iter = malloc(PYRAMID_TILE * PYRAMID_TILE * sizeof(*iter));
+	unsigned char *out = malloc(IMAGE_HEADER_MAX + PYRAMID_TILE * PYRAMID_TILE * sizeof(*iter));
+	int z, n, t;
+
+	if (iter == NULL || out == NULL) {
+		perror("pyramid_worker: malloc");
+		exit(1);
+	}
+
+	for (z = 0; z <= pyr_levels; z++) {
+		n = 1 << z;
+		while ((t = __sync_fetch_and_add(&next_tile[z], 1)) < n * n)
+			pyramid_tile(z, t % n, t / n, iter, out, st);
+		pthread_barrier_wait(&level_done);
+	}
+
+	free(iter);
+	free(out);
+	return NULL;
+}
+
+static void make_dir(const char *path)
+{
+	if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+		perror("make_dir: mkdir");
+		exit(1);
+	}
+}
+
+/*
+ * Render the tile pyramid of levels 0 to levels of the view with center
+ * (cx, cy) and half width r, with max iterations, into the directory or
+ * tar archive at path, in format and color mapping colors, with a pool
+ * of nworkers threads.
+ */
+void pyramid_run(const char *path, int levels, int format, int colors, int max, int precision,
+	dd cx, dd cy, double r, int nworkers)
+{
+	struct mandel_stats *stats, total;
+	struct timespec t0, t1;
+	pthread_t *tid;
+	char dir[4096];
+	size_t len = strlen(path);
+	long tiles;
+	double wall;
+	int z, x, i;
+
+	pyr_path = path;
+	pyr_levels = levels;
+	pyr_format = format;
+	pyr_colors = colors;
+	pyr_max = max;
+	pyr_precision = precision;
+	pyr_cx = cx;
+	pyr_cy = cy;
+	pyr_r = r;
+
+	if (len > 4 && strcmp(path + len - 4, ".tar") == 0) {
+		if ((pyr_tar = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+			perror("pyramid_run: open");
+			exit(1);
+		}
+		pyr_mtime = time(NULL);
+	} else {
+		make_dir(path);
+		for (z = 0; z <= levels; z++) {
+			snprintf(dir, sizeof(dir), "%s/%d", path, z);
+			make_dir(dir);
+			for (x = 0; x < (1 << z); x++) {
+				snprintf(dir, sizeof(dir), "%s/%d/%d", path, z, x);
+				make_dir(dir);
+			}
+		}
+	}
+
+	for (z = 0, tiles = 0; z <= levels; z++) {
+		tiles += 1L << (2 * z);
+		if (z < levels && (uniform[z] = malloc(((size_t)1 << (2 * z)) * sizeof(int))) == NULL) {
+			perror("pyramid_run: malloc");
+			exit(1);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	stats = calloc(nworkers, sizeof(*stats));
+	tid = calloc(nworkers, sizeof(*tid));
+	if (stats == NULL || tid == NULL) {
+		perror("pyramid_run: calloc");
+		exit(1);
+	}
+	if ((errno = pthread_barrier_init(&level_done, NULL, nworkers)) != 0) {
+		perror("pyramid_run: pthread_barrier_init");
+		exit(1);
+	}
+	for (i = 0; i < nworkers; i++) {
+		if ((errno = pthread_create(&tid[i], NULL, pyramid_worker, &stats[i])) != 0) {
+			perror("pyramid_run: pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nworkers; i++)
+		pthread_join(tid[i], NULL);
+	pthread_barrier_destroy(&level_done);
+
+	/* The end of the archive is two blocks of zeroes */
+	if (pyr_tar >= 0) {
+		char end[2 * TAR_BLOCK];
+
+		memset(end, 0, sizeof(end));
+		if (insist_write(pyr_tar, end, sizeof(end)) != sizeof(end) || close(pyr_tar) < 0) {
+			perror("pyramid_run: write");
+			exit(1);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < nworkers; i++)
+		mandel_stats_add(&total, &stats[i]);
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	fprintf(stderr, "%ld tiles of levels 0-%d in %.3fs, %d workers, kernel %s\n",
+		tiles, levels, wall, nworkers, mandel_kernel_name());
+	fprintf(stderr, "Uniform: %d tiles proven, %d filled in without iterating\n",
+		tiles_proven, tiles_filled);
+	fprintf(stderr, "%lu points, %lu iterations\n", total.points, total.iterations);
+
+	for (z = 0; z < levels; z++)
+		free(uniform[z]);
+	free(stats);
+	free(tid);
+}
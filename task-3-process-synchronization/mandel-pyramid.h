@@ -0,0 +1,30 @@
+/*
+ * mandel-pyramid.h
+ *
+ * Tile pyramids of the Mandelbrot Set for zoomable maps: levels
+ * 0 to some level of z/x/y tiles, rendered with a pool of threads
+ * into a directory or a single tar archive.
+ *
+ */
+
+#ifndef MANDEL_PYRAMID_H__
+#define MANDEL_PYRAMID_H__
+
+#include "mandel-dd.h"
+
+/* Tiles are PYRAMID_TILE x PYRAMID_TILE pixels */
+#define PYRAMID_TILE 256
+
+/* Deepest level; level z has 4^z tiles */
+#define PYRAMID_MAX_LEVEL 12
+
+/* What level 0 covers unless -v says otherwise: all of the set */
+#define PYRAMID_CX -0.75
+#define PYRAMID_CY 0.0
+#define PYRAMID_R 1.5
+
+/* Function prototypes */
+void pyramid_run(const char *path, int levels, int format, int colors, int max, int precision,
+	dd cx, dd cy, double r, int nworkers);
+
+#endif /* MANDEL_PYRAMID_H__ */
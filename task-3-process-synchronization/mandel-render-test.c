@@ -0,0 +1,111 @@
+/*
+ * mandel-render-test.c
+ *
+ * A program to verify that renders with mandel_render() are reentrant:
+ * four different renders, of the Mandelbrot Set in float and double,
+ * a Julia set and a deep zoom, run in threads at the same time, over
+ * and over, and must give the same counts as when run one at a time.
+ * This is done with every kernel the machine supports.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mandel-lib.h"
+#include "mandel-dd.h"
+#include "mandel-deep.h"
+
+#define WIDTH  160
+#define HEIGHT 120
+#define ROUNDS 5
+
+struct render {
+	const char *name;
+	struct mandel_params params;
+	struct mandel_deep deep;
+	int expect[WIDTH * HEIGHT], iter[WIDTH * HEIGHT];
+	int bad;                   /* rounds with other counts than expect[] */
+};
+
+static struct render renders[4];
+
+static void *render_thread(void *arg)
+{
+	struct render *r = arg;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		memset(r->iter, 0, sizeof(r->iter));
+		mandel_render(&r->params, r->iter, NULL);
+		if (memcmp(r->iter, r->expect, sizeof(r->iter)) != 0)
+			r->bad++;
+	}
+	return NULL;
+}
+
+static void setup(struct render *r, const char *name, const char *cx, const char *cy,
+	double rad, int max, int julia, int precision)
+{
+	dd x, y;
+
+	dd_parse(cx, &x, NULL);
+	dd_parse(cy, &y, NULL);
+	r->name = name;
+	r->params.julia = julia;
+	r->params.julia_cx = -0.8;
+	r->params.julia_cy = 0.156;
+	r->params.precision = precision;
+	if (deep_view(&r->params, &r->deep, WIDTH, HEIGHT, x, y, rad, max) < 0) {
+		perror("setup: deep_view");
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	pthread_t tid[4];
+	const char *kernel;
+	int i, k, ret = 0;
+
+	setup(&renders[0], "float", "-0.5", "0", 1.5, 1000, 0, MANDEL_FLOAT);
+	setup(&renders[1], "double", "-0.75", "0.1", 0.05, 2000, 0, MANDEL_DOUBLE);
+	setup(&renders[2], "julia", "0", "0", 1.5, 1000, 1, 0);
+	setup(&renders[3], "deep", "-0.743643887037158704752191506114774",
+		"0.131825904205311970493132056385139", 1e-20, 1000, 0, 0);
+	if (renders[3].params.precision != MANDEL_DEEP) {
+		fprintf(stderr, "deep: view not deep enough for perturbation\n");
+		exit(1);
+	}
+
+	for (k = 0; (kernel = mandel_kernel_list(k)) != NULL; k++) {
+		mandel_set_kernel(kernel);
+
+		/* One at a time */
+		for (i = 0; i < 4; i++) {
+			mandel_render(&renders[i].params, renders[i].expect, NULL);
+			renders[i].bad = 0;
+		}
+
+		/* All at once */
+		for (i = 0; i < 4; i++) {
+			if ((errno = pthread_create(&tid[i], NULL, render_thread, &renders[i])) != 0) {
+				perror("main: pthread_create");
+				exit(1);
+			}
+		}
+		for (i = 0; i < 4; i++)
+			pthread_join(tid[i], NULL);
+
+		for (i = 0; i < 4; i++) {
+			printf("Kernel %s, %s: %d of %d concurrent renders differ\n",
+				kernel, renders[i].name, renders[i].bad, ROUNDS);
+			if (renders[i].bad)
+				ret = 1;
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,111 @@
+/*
+ * mandel-render.c
+ *
+ * Reentrant rendering: everything a render needs is in its
+ * struct mandel_params, and its results go to the caller's buffer.
+ * The CLI in mandel.c is one user of it; anything else that links
+ * these objects can render without forking it.
+ *
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include "mandel-lib.h"
+#include "mandel-deep.h"
+
+/*
+ * Set up p for a width x height render of the part of the plane
+ * from (xmin, ymax) to (xmax, ymin), with max iterations per point,
+ * of the Mandelbrot Set. The precision is the cheapest one that
+ * resolves the step between points, but at most double: for deeper
+ * views set up a reference orbit and MANDEL_DEEP, see mandel-deep.h.
+ */
+void mandel_params_init(struct mandel_params *p, int width, int height,
+	double xmin, double xmax, double ymin, double ymax, int max)
+{
+	double mag;
+
+	p->width = width;
+	p->height = height;
+	p->xmin = xmin;
+	p->ymax = ymax;
+	p->xstep = (xmax - xmin) / width;
+	p->ystep = (ymax - ymin) / height;
+	p->max = max;
+	p->from = 0;
+	p->mirror = -1;
+	p->julia = 0;
+	p->julia_cx = p->julia_cy = 0.0;
+	p->deep = NULL;
+
+	/* Orbits that matter stay within |z| <= 2 */
+	mag = fmax(fmax(fabs(xmin), fabs(xmax)), fmax(fabs(ymin), fabs(ymax)));
+	p->precision = mandel_precision_for(fmin(p->xstep, p->ystep), fmax(mag, 2.0), max);
+	if (p->precision == MANDEL_DEEP)
+		p->precision = MANDEL_DOUBLE;
+}
+
+/*
+ * The y of row row of p.
+ */
+static double row_y(const struct mandel_params *p, int row)
+{
+	if (p->mirror >= 0)
+		return (0.5 * p->mirror - row) * p->ystep;
+	return p->ymax - p->ystep * row;
+}
+
+/*
+ * Compute the iteration counts of n points of row row of p,
+ * starting at point x, into iter[0] to iter[n - 1].
+ * Work counters are added to st, if not NULL.
+ */
+void mandel_render_span(const struct mandel_params *p, int row, int x, int n, int iter[],
+	struct mandel_stats *st)
+{
+	double px = p->xmin + x * p->xstep;
+	double py = row_y(p, row);
+
+	if (p->precision == MANDEL_DEEP && p->deep != NULL && !p->julia)
+		deep_iterations_line(p->deep, px, p->xstep, py, n, iter, st);
+	else
+		mandel_iterations_line(p, px, py, n, iter, NULL, NULL, st);
+}
+
+/*
+ * The same, saving the z every point stopped at into zx[] and zy[],
+ * or NAN for points known to be inside. With p->from, iter[], zx[]
+ * and zy[] hold what a render of the same points with max p->from
+ * left there, and only the points that ran out of iterations then are
+ * iterated further, up to p->max. The counts are the same as from
+ * scratch, as long as the precision is the same as then.
+ * Not for MANDEL_DEEP, whose orbits are offsets from the reference.
+ */
+void mandel_render_span_orbits(const struct mandel_params *p, int row, int x, int n, int iter[],
+	double zx[], double zy[], struct mandel_stats *st)
+{
+	mandel_iterations_line(p, p->xmin + x * p->xstep, row_y(p, row),
+		n, iter, zx, zy, st);
+}
+
+/*
+ * Compute rows first to first + count - 1 of p, one after the other,
+ * into iter[], which holds count * p->width points.
+ */
+void mandel_render_rows(const struct mandel_params *p, int first, int count, int iter[],
+	struct mandel_stats *st)
+{
+	int r;
+
+	for (r = 0; r < count; r++)
+		mandel_render_span(p, first + r, 0, p->width, &iter[(size_t)r * p->width], st);
+}
+
+/*
+ * Compute all of p into iter[], which holds p->width * p->height points.
+ */
+void mandel_render(const struct mandel_params *p, int iter[], struct mandel_stats *st)
+{
+	mandel_render_rows(p, 0, p->height, iter, st);
+}
@@ -0,0 +1,92 @@
+/*
+ * mandel-resume-test.c
+ *
+ * A program to verify that renders resumed from saved orbits give the
+ * same counts as from scratch: every view is rendered with a low limit,
+ * saving the orbits with mandel_render_span_orbits(), then resumed
+ * from there with a higher one, and compared with a render with the
+ * higher limit right away. This is done with every kernel the machine
+ * supports, in float and double, for the Mandelbrot Set and a Julia set.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandel-lib.h"
+
+#define WIDTH  200
+#define HEIGHT 150
+#define FROM   100
+#define MAX    2000
+
+static int iter[WIDTH * HEIGHT], expect[WIDTH * HEIGHT];
+static double zx[WIDTH * HEIGHT], zy[WIDTH * HEIGHT];
+
+/*
+ * Render all of p into iter[], row by row, saving the orbits.
+ */
+static void render_orbits(const struct mandel_params *p)
+{
+	int r;
+
+	for (r = 0; r < p->height; r++)
+		mandel_render_span_orbits(p, r, 0, p->width, &iter[r * p->width],
+			&zx[r * p->width], &zy[r * p->width], NULL);
+}
+
+/*
+ * Return the number of points where resuming p at FROM
+ * gives other counts than rendering it with MAX at once.
+ */
+static int resume(struct mandel_params *p)
+{
+	int i, bad = 0;
+
+	p->max = MAX;
+	p->from = 0;
+	mandel_render(p, expect, NULL);
+
+	p->max = FROM;
+	render_orbits(p);
+	p->max = MAX;
+	p->from = FROM;
+	render_orbits(p);
+
+	for (i = 0; i < WIDTH * HEIGHT; i++)
+		bad += (iter[i] != expect[i]);
+	return bad;
+}
+
+int main(void)
+{
+	static const int precisions[] = { MANDEL_FLOAT, MANDEL_DOUBLE };
+	struct mandel_params p;
+	const char *kernel;
+	int k, j, julia, bad, ret = 0;
+
+	for (k = 0; (kernel = mandel_kernel_list(k)) != NULL; k++) {
+		mandel_set_kernel(kernel);
+		for (j = 0; j < 2; j++) {
+			for (julia = 0; julia <= 1; julia++) {
+				if (julia) {
+					mandel_params_init(&p, WIDTH, HEIGHT, -1.6, 1.6, -1.2, 1.2, MAX);
+					p.julia = 1;
+					p.julia_cx = -0.8;
+					p.julia_cy = 0.156;
+				} else {
+					mandel_params_init(&p, WIDTH, HEIGHT, -0.85, -0.65, 0.025, 0.175, MAX);
+				}
+				p.precision = precisions[j];
+
+				bad = resume(&p);
+				printf("Kernel %s, %s, %s: %d points differ\n", kernel,
+					j ? "double" : "float", julia ? "Julia set" : "Mandelbrot Set", bad);
+				if (bad)
+					ret = 1;
+			}
+		}
+	}
+	return ret;
+}
@@ -0,0 +1,175 @@
+/*
+ * mandel-simd-kernel.h
+ *
+ * Template for a vectorized escape time kernel.
+ *
+ * This file is included by mandel-simd.c once per instruction set,
+ * after defining the following macros:
+ *
+ *   KERNEL          name of the function to generate
+ *   FT              element type, double or float
+ *   LANES           number of elements per vector register
+ *   VD              vector type
+ *   V_SET1(a)       broadcast a value to all lanes
+ *   V_LOAD(p)       load LANES elements from p
+ *   V_STORE(p,v)    store LANES elements to p
+ *   V_ADD, V_SUB, V_MUL
+ *   V_CMPLE(a,b)    lane-wise a <= b, as a mask
+ *   V_CMPEQ(a,b)    lane-wise a == b, as a mask
+ *   V_BLEND(m,a,b)  lane-wise m ? a : b
+ *   M_AND(a,b)      and of two masks
+ *   M_BITS(m)       mask as an integer, one bit per lane
+ *
+ * and undefines them again at the end, ready for the next one.
+ *
+ * Every lane iterates its own point: z starts at the pixel, and c is
+ * the pixel as well for the Mandelbrot Set, or the Julia parameter.
+ * Everything else comes from p, so kernels can run concurrently. As soon as a lane escapes,
+ * reaches max or falls into a cycle, its result is stored and the lane
+ * is refilled with the next pixel of the line, so a single slow point
+ * never leaves the rest of the register idle.
+ *
+ * Cycles are detected as in mandel_iterations_at_point_stats(),
+ * with a per-lane Brent snapshot taken at iterations 1, 2, 4, ...
+ * Iteration counters are kept in FT as well, so with float
+ * they are exact only up to MANDEL_FLOAT_MAX_ITER.
+ *
+ * With zx and zy, the z every point stopped at is saved there, or NAN
+ * if it is known to be inside, and with p->from points that stopped at
+ * p->from go on from there, see start_pixel(). A resumed orbit takes
+ * its first snapshot where it goes on, so it is the same orbit as from
+ * scratch, and ends the same way.
+ */
+
+static void KERNEL(const struct mandel_params *p, double x, double y, int n, int iter[],
+	double zx_o[], double zy_o[], struct mandel_stats *st)
+{
+	const double xstep = p->xstep;
+	const int max = p->max;
+	FT zx_a[LANES] __attribute__((aligned(64)));
+	FT zy_a[LANES] __attribute__((aligned(64)));
+	FT cx_a[LANES] __attribute__((aligned(64)));
+	FT sx_a[LANES] __attribute__((aligned(64)));
+	FT sy_a[LANES] __attribute__((aligned(64)));
+	FT it_a[LANES] __attribute__((aligned(64)));
+	FT sn_a[LANES] __attribute__((aligned(64)));
+	int idx[LANES], start[LANES];
+	double z0x, z0y;
+
+	struct mandel_stats ls = { 0 };
+	VD zx, zy, cx, cy, sx, sy, it, snap, x2, y2;
+	VD four = V_SET1(4.0), one = V_SET1(1.0), vlim = V_SET1((FT)max - 1);
+	int l, bits, cyc, live, next = 0;
+
+	cy = V_SET1(p->julia ? p->julia_cy : y);
+
+	/* Load the first LANES pixels, park the rest of the lanes at z = 0 */
+	live = 0;
+	for (l = 0; l < LANES; l++) {
+		idx[l] = claim_pixel(p, x, y, n, iter, zx_o, zy_o, &next, &ls);
+		start[l] = 0;
+		if (idx[l] >= 0) {
+			start[l] = start_pixel(p, x, y, idx[l], zx_o, zy_o, &z0x, &z0y);
+			zx_a[l] = z0x;
+			zy_a[l] = z0y;
+			cx_a[l] = p->julia ? p->julia_cx : x + idx[l] * xstep;
+			live |= 1 << l;
+		} else {
+			zx_a[l] = zy_a[l] = cx_a[l] = 0.0;
+		}
+		sx_a[l] = sy_a[l] = NAN;
+		it_a[l] = start[l];
+		sn_a[l] = start[l] ? start[l] : 1.0;
+	}
+	zx = V_LOAD(zx_a); zy = V_LOAD(zy_a); cx = V_LOAD(cx_a);
+	sx = V_LOAD(sx_a); sy = V_LOAD(sy_a);
+	it = V_LOAD(it_a); snap = V_LOAD(sn_a);
+
+	while (live) {
+		x2 = V_MUL(zx, zx);
+		y2 = V_MUL(zy, zy);
+
+		/* A lane is active while |z|^2 <= 4 and it < max, i.e. it <= max - 1 */
+		bits = M_BITS(M_AND(V_CMPLE(V_ADD(x2, y2), four), V_CMPLE(it, vlim)));
+		/* ...and its orbit has not come back to the snapshot */
+		cyc = M_BITS(M_AND(V_CMPEQ(zx, sx), V_CMPEQ(zy, sy)));
+		bits &= ~cyc;
+
+		if ((bits & live) != live) {
+			/*
+			 * At least one live lane is done:
+			 * store its result and refill it with the next pixel.
+			 */
+			V_STORE(zx_a, zx); V_STORE(zy_a, zy); V_STORE(cx_a, cx);
+			V_STORE(sx_a, sx); V_STORE(sy_a, sy);
+			V_STORE(it_a, it); V_STORE(sn_a, snap);
+			for (l = 0; l < LANES; l++) {
+				if (!(live & (1 << l)) || (bits & (1 << l)))
+					continue;
+
+				ls.points++;
+				ls.iterations += (unsigned long)it_a[l] - start[l];
+				if (cyc & (1 << l)) {
+					ls.cycles++;
+					iter[idx[l]] = max;
+				} else {
+					iter[idx[l]] = (int)it_a[l];
+				}
+				if (zx_o != NULL) {
+					zx_o[idx[l]] = (cyc & (1 << l)) ? NAN : zx_a[l];
+					zy_o[idx[l]] = (cyc & (1 << l)) ? NAN : zy_a[l];
+				}
+
+				idx[l] = claim_pixel(p, x, y, n, iter, zx_o, zy_o, &next, &ls);
+				start[l] = 0;
+				if (idx[l] >= 0) {
+					start[l] = start_pixel(p, x, y, idx[l], zx_o, zy_o, &z0x, &z0y);
+					zx_a[l] = z0x;
+					zy_a[l] = z0y;
+					cx_a[l] = p->julia ? p->julia_cx : x + idx[l] * xstep;
+				} else {
+					zx_a[l] = zy_a[l] = cx_a[l] = 0.0;
+					live &= ~(1 << l);
+				}
+				sx_a[l] = sy_a[l] = NAN;
+				it_a[l] = start[l];
+				sn_a[l] = start[l] ? start[l] : 1.0;
+			}
+			zx = V_LOAD(zx_a); zy = V_LOAD(zy_a); cx = V_LOAD(cx_a);
+			sx = V_LOAD(sx_a); sy = V_LOAD(sy_a);
+			it = V_LOAD(it_a); snap = V_LOAD(sn_a);
+			continue;
+		}
+
+		/* Take the Brent snapshot in lanes that reached it */
+		if (M_BITS(V_CMPEQ(it, snap))) {
+			sx = V_BLEND(V_CMPEQ(it, snap), zx, sx);
+			sy = V_BLEND(V_CMPEQ(it, snap), zy, sy);
+			snap = V_BLEND(V_CMPEQ(it, snap), V_ADD(snap, snap), snap);
+		}
+
+		/* All live lanes are still active, take one step */
+		zy = V_ADD(V_MUL(V_ADD(zx, zx), zy), cy);
+		zx = V_ADD(V_SUB(x2, y2), cx);
+		it = V_ADD(it, one);
+	}
+
+	if (st)
+		mandel_stats_add(st, &ls);
+}
+
+#undef KERNEL
+#undef FT
+#undef LANES
+#undef VD
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_CMPLE
+#undef V_CMPEQ
+#undef V_BLEND
+#undef M_AND
+#undef M_BITS
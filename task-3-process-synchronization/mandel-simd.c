@@ -0,0 +1,389 @@
+/*
+ * mandel-simd.c
+ *
+ * Vectorized escape time kernels for whole lines of the Mandelbrot Set,
+ * or of a Julia set, with the instruction set selected at runtime.
+ *
+ * Every kernel gives the same counts as the scalar code only as long as
+ * the compiler does not fuse a multiply and an add into an FMA, which
+ * rounds once instead of twice: the Makefile builds this file with
+ * -ffp-contract=off, and so must any other build.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "mandel-lib.h"
+
+typedef void mandel_line_fn(const struct mandel_params *p, double x, double y, int n, int iter[],
+	double zx[], double zy[], struct mandel_stats *st);
+
+/*
+ * Return the index of the next pixel of the line that has to be iterated,
+ * or -1 at the end of the line. Pixels skipped on the way are inside
+ * the main cardioid or the period-2 bulb, and get max right away.
+ * Those shortcuts only hold for the Mandelbrot Set.
+ *
+ * When resuming from p->from iterations, only the pixels that ran out
+ * of iterations then are iterated further. The others escaped, and
+ * keep their count, or are known to be inside, and get max.
+ */
+static inline int claim_pixel(const struct mandel_params *p, double x, double y, int n, int iter[],
+	double zx[], double zy[], int *next, struct mandel_stats *st)
+{
+	int i, shortcut;
+
+	while (*next < n) {
+		i = (*next)++;
+		if (p->from > 0) {
+			if (iter[i] < p->from)
+				continue;
+			if (!isnan(zx[i]))
+				return i;
+			iter[i] = p->max;
+			continue;
+		}
+		if (p->julia)
+			return i;
+		shortcut = mandel_interior_shortcut(x + i * p->xstep, y);
+		if (!shortcut)
+			return i;
+
+		iter[i] = p->max;
+		if (zx != NULL)
+			zx[i] = zy[i] = NAN;
+		st->points++;
+		if (shortcut == MANDEL_CARDIOID)
+			st->cardioid++;
+		else
+			st->bulb++;
+	}
+
+	return -1;
+}
+
+/*
+ * Where pixel i of the line starts: at z = the pixel and iteration 0,
+ * or when resuming at the z it stopped at, and iteration p->from.
+ * Returns the iteration.
+ */
+static inline int start_pixel(const struct mandel_params *p, double x, double y, int i,
+	const double zx[], const double zy[], double *z0x, double *z0y)
+{
+	if (p->from > 0) {
+		*z0x = zx[i];
+		*z0y = zy[i];
+		return p->from;
+	}
+	*z0x = x + i * p->xstep;
+	*z0y = y;
+	return 0;
+}
+
+/*
+ * Portable fallback: the template with a single lane,
+ * so that it computes exactly what the vector kernels do.
+ */
+#define KERNEL         mandel_line_scalar
+#define FT             double
+#define LANES          1
+#define VD             double
+#define V_SET1(a)      ((double)(a))
+#define V_LOAD(p)      (*(p))
+#define V_STORE(p, v)  (*(p) = (v))
+#define V_ADD(a, b)    ((a) + (b))
+#define V_SUB(a, b)    ((a) - (b))
+#define V_MUL(a, b)    ((a) * (b))
+#define V_CMPLE(a, b)  ((a) <= (b))
+#define V_CMPEQ(a, b)  ((a) == (b))
+#define V_BLEND(m, a, b) ((m) ? (a) : (b))
+#define M_AND(a, b)    ((a) & (b))
+#define M_BITS(m)      ((int)(m))
+#include "mandel-simd-kernel.h"
+
+#define KERNEL         mandel_line_scalar_float
+#define FT             float
+#define LANES          1
+#define VD             float
+#define V_SET1(a)      ((float)(a))
+#define V_LOAD(p)      (*(p))
+#define V_STORE(p, v)  (*(p) = (v))
+#define V_ADD(a, b)    ((a) + (b))
+#define V_SUB(a, b)    ((a) - (b))
+#define V_MUL(a, b)    ((a) * (b))
+#define V_CMPLE(a, b)  ((a) <= (b))
+#define V_CMPEQ(a, b)  ((a) == (b))
+#define V_BLEND(m, a, b) ((m) ? (a) : (b))
+#define M_AND(a, b)    ((a) & (b))
+#define M_BITS(m)      ((int)(m))
+#include "mandel-simd-kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+/*
+ * SSE2: 2 points per register in double, 4 in float
+ */
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+#define KERNEL         mandel_line_sse2
+#define FT             double
+#define LANES          2
+#define VD             __m128d
+#define V_SET1(a)      _mm_set1_pd(a)
+#define V_LOAD(p)      _mm_load_pd(p)
+#define V_STORE(p, v)  _mm_store_pd(p, v)
+#define V_ADD(a, b)    _mm_add_pd(a, b)
+#define V_SUB(a, b)    _mm_sub_pd(a, b)
+#define V_MUL(a, b)    _mm_mul_pd(a, b)
+#define V_CMPLE(a, b)  _mm_cmple_pd(a, b)
+#define V_CMPEQ(a, b)  _mm_cmpeq_pd(a, b)
+#define V_BLEND(m, a, b) _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b))
+#define M_AND(a, b)    _mm_and_pd(a, b)
+#define M_BITS(m)      _mm_movemask_pd(m)
+#include "mandel-simd-kernel.h"
+
+#define KERNEL         mandel_line_sse2_float
+#define FT             float
+#define LANES          4
+#define VD             __m128
+#define V_SET1(a)      _mm_set1_ps(a)
+#define V_LOAD(p)      _mm_load_ps(p)
+#define V_STORE(p, v)  _mm_store_ps(p, v)
+#define V_ADD(a, b)    _mm_add_ps(a, b)
+#define V_SUB(a, b)    _mm_sub_ps(a, b)
+#define V_MUL(a, b)    _mm_mul_ps(a, b)
+#define V_CMPLE(a, b)  _mm_cmple_ps(a, b)
+#define V_CMPEQ(a, b)  _mm_cmpeq_ps(a, b)
+#define V_BLEND(m, a, b) _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#define M_AND(a, b)    _mm_and_ps(a, b)
+#define M_BITS(m)      _mm_movemask_ps(m)
+#include "mandel-simd-kernel.h"
+
+#pragma GCC pop_options
+
+/*
+ * AVX2: 4 points per register in double, 8 in float
+ */
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#define KERNEL         mandel_line_avx2
+#define FT             double
+#define LANES          4
+#define VD             __m256d
+#define V_SET1(a)      _mm256_set1_pd(a)
+#define V_LOAD(p)      _mm256_load_pd(p)
+#define V_STORE(p, v)  _mm256_store_pd(p, v)
+#define V_ADD(a, b)    _mm256_add_pd(a, b)
+#define V_SUB(a, b)    _mm256_sub_pd(a, b)
+#define V_MUL(a, b)    _mm256_mul_pd(a, b)
+#define V_CMPLE(a, b)  _mm256_cmp_pd(a, b, _CMP_LE_OQ)
+#define V_CMPEQ(a, b)  _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+#define V_BLEND(m, a, b) _mm256_blendv_pd(b, a, m)
+#define M_AND(a, b)    _mm256_and_pd(a, b)
+#define M_BITS(m)      _mm256_movemask_pd(m)
+#include "mandel-simd-kernel.h"
+
+#define KERNEL         mandel_line_avx2_float
+#define FT             float
+#define LANES          8
+#define VD             __m256
+#define V_SET1(a)      _mm256_set1_ps(a)
+#define V_LOAD(p)      _mm256_load_ps(p)
+#define V_STORE(p, v)  _mm256_store_ps(p, v)
+#define V_ADD(a, b)    _mm256_add_ps(a, b)
+#define V_SUB(a, b)    _mm256_sub_ps(a, b)
+#define V_MUL(a, b)    _mm256_mul_ps(a, b)
+#define V_CMPLE(a, b)  _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define V_CMPEQ(a, b)  _mm256_cmp_ps(a, b, _CMP_EQ_OQ)
+#define V_BLEND(m, a, b) _mm256_blendv_ps(b, a, m)
+#define M_AND(a, b)    _mm256_and_ps(a, b)
+#define M_BITS(m)      _mm256_movemask_ps(m)
+#include "mandel-simd-kernel.h"
+
+#pragma GCC pop_options
+
+/*
+ * AVX-512: 8 points per register in double, 16 in float,
+ * comparisons yield mask registers
+ */
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define KERNEL         mandel_line_avx512
+#define FT             double
+#define LANES          8
+#define VD             __m512d
+#define V_SET1(a)      _mm512_set1_pd(a)
+#define V_LOAD(p)      _mm512_load_pd(p)
+#define V_STORE(p, v)  _mm512_store_pd(p, v)
+#define V_ADD(a, b)    _mm512_add_pd(a, b)
+#define V_SUB(a, b)    _mm512_sub_pd(a, b)
+#define V_MUL(a, b)    _mm512_mul_pd(a, b)
+#define V_CMPLE(a, b)  _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ)
+#define V_CMPEQ(a, b)  _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ)
+#define V_BLEND(m, a, b) _mm512_mask_blend_pd(m, b, a)
+#define M_AND(a, b)    ((__mmask8)((a) & (b)))
+#define M_BITS(m)      ((int)(m))
+#include "mandel-simd-kernel.h"
+
+#define KERNEL         mandel_line_avx512_float
+#define FT             float
+#define LANES          16
+#define VD             __m512
+#define V_SET1(a)      _mm512_set1_ps(a)
+#define V_LOAD(p)      _mm512_load_ps(p)
+#define V_STORE(p, v)  _mm512_store_ps(p, v)
+#define V_ADD(a, b)    _mm512_add_ps(a, b)
+#define V_SUB(a, b)    _mm512_sub_ps(a, b)
+#define V_MUL(a, b)    _mm512_mul_ps(a, b)
+#define V_CMPLE(a, b)  _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ)
+#define V_CMPEQ(a, b)  _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ)
+#define V_BLEND(m, a, b) _mm512_mask_blend_ps(m, b, a)
+#define M_AND(a, b)    ((__mmask16)((a) & (b)))
+#define M_BITS(m)      ((int)(m))
+#include "mandel-simd-kernel.h"
+
+#pragma GCC pop_options
+
+static int cpu_has_sse2(void)   { return __builtin_cpu_supports("sse2"); }
+static int cpu_has_avx2(void)   { return __builtin_cpu_supports("avx2"); }
+static int cpu_has_avx512(void) { return __builtin_cpu_supports("avx512f"); }
+
+#endif /* x86 */
+
+static int cpu_has_nothing(void) { return 1; }
+
+/*
+ * All available kernels, best first,
+ * each in double and in single precision.
+ */
+static const struct {
+	const char *name;
+	mandel_line_fn *fn;
+	mandel_line_fn *float_fn;
+	int (*supported)(void);
+} kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx512", mandel_line_avx512, mandel_line_avx512_float, cpu_has_avx512 },
+	{ "avx2",   mandel_line_avx2,   mandel_line_avx2_float,   cpu_has_avx2 },
+	{ "sse2",   mandel_line_sse2,   mandel_line_sse2_float,   cpu_has_sse2 },
+#endif
+	{ "scalar", mandel_line_scalar, mandel_line_scalar_float, cpu_has_nothing },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/*
+ * The selected kernel. This is the only state shared by all renders:
+ * it depends on the CPU, not on what is rendered.
+ */
+static int current = -1;
+
+/*
+ * Select a kernel by name, or the best one the CPU supports
+ * if name is NULL or "auto". Returns -1 if the kernel is unknown
+ * or not supported by this CPU.
+ */
+int mandel_set_kernel(const char *name)
+{
+	int i;
+
+	for (i = 0; kernels[i].name != NULL; i++) {
+		if (name != NULL && strcmp(name, "auto") != 0 &&
+		    strcmp(name, kernels[i].name) != 0)
+			continue;
+		if (!kernels[i].supported())
+			continue;
+		__atomic_store_n(&current, i, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Name of the i-th kernel this CPU supports, best first,
+ * or NULL past the last one.
+ */
+const char *mandel_kernel_list(int i)
+{
+	int k;
+
+	for (k = 0; kernels[k].name != NULL; k++)
+		if (kernels[k].supported() && i-- == 0)
+			return kernels[k].name;
+	return NULL;
+}
+
+/*
+ * Index of the selected kernel, choosing the best one on first use.
+ * Renders in different threads may race to choose it, but they all
+ * choose the same one.
+ */
+static int kernel_index(void)
+{
+	if (__atomic_load_n(&current, __ATOMIC_RELAXED) < 0)
+		mandel_set_kernel(NULL);
+	return __atomic_load_n(&current, __ATOMIC_RELAXED);
+}
+
+const char *mandel_kernel_name(void)
+{
+	return kernels[kernel_index()].name;
+}
+
+/*
+ * The cheapest precision that still tells neighbouring pixels apart:
+ * the pixel step must stay well above the spacing of representable
+ * numbers around the view, whose coordinates and orbits are at most
+ * mag in absolute value. Float also needs few enough iterations for
+ * rounding to leave the counts alone, see MANDEL_FLOAT_AUTO_ITER.
+ * Past what double can resolve, only the deep zoom path will do.
+ */
+int mandel_precision_for(double step, double mag, int max)
+{
+	if (max <= MANDEL_FLOAT_AUTO_ITER &&
+	    step >= mag * FLT_EPSILON * MANDEL_PRECISION_MARGIN)
+		return MANDEL_FLOAT;
+	if (step >= mag * DBL_EPSILON * MANDEL_PRECISION_MARGIN)
+		return MANDEL_DOUBLE;
+	return MANDEL_DEEP;
+}
+
+const char *mandel_precision_name(int prec)
+{
+	switch (prec) {
+	case MANDEL_FLOAT:
+		return "float";
+	case MANDEL_DOUBLE:
+		return "double";
+	case MANDEL_DEEP:
+		return "deep";
+	}
+	return "auto";
+}
+
+/*
+ * Compute the escape time for n points on a horizontal line of p,
+ * starting at (x, y) and moving p->xstep units to the right,
+ * using the selected vector kernel in the precision of p.
+ * If zx and zy are not NULL, the orbits are saved there, and
+ * resumed from there if p->from is set, see mandel_render_span_orbits().
+ * Work counters are added to st, if not NULL.
+ */
+void mandel_iterations_line(const struct mandel_params *p, double x, double y, int n, int iter[],
+	double zx[], double zy[], struct mandel_stats *st)
+{
+	int k = kernel_index();
+
+	if (p->precision == MANDEL_FLOAT && p->max <= MANDEL_FLOAT_MAX_ITER)
+		kernels[k].float_fn(p, x, y, n, iter, zx, zy, st);
+	else
+		kernels[k].fn(p, x, y, n, iter, zx, zy, st);
+}
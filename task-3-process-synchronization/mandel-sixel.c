@@ -0,0 +1,180 @@
+/*
+ * mandel-sixel.c
+ *
+ * Sixel graphics output at the terminal.
+ *
+ * A sixel picture is a DCS string: its size, the color registers,
+ * then bands of six pixel rows. A band is drawn one register at a
+ * time: "#n" selects register n, then every column is a character,
+ * '?' plus the six bits of the pixels of the band in that color,
+ * the top row in the lowest bit. "$" goes back to the start of the
+ * band for the next register, "-" on to the next band, and "!n c"
+ * is n times c.
+ *
+ * Pixels have palette colors, but terminals may have fewer color
+ * registers than palette entries. Then runs of neighbouring entries,
+ * which have similar colors, share a register with their mean color.
+ *
+ * A band is encoded in two passes. The first goes through it column
+ * by column, and appends the sixel of every register in the column to
+ * the list of that register. The second writes out only the registers
+ * used, and of each only its listed columns: gaps and runs of the same
+ * sixel are compressed, and nothing comes after the last column. So a
+ * band takes time in proportion to its pixels, however many registers
+ * it uses, and every list is written and read in order.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandel-lib.h"
+#include "mandel-sixel.h"
+
+/* Longest definition of a register, "#255;2;100;100;100" */
+#define SIXEL_REGISTER_MAX 20
+
+void sixel_init(struct sixel *s, int w, int h, int colors)
+{
+	size_t band = (size_t)colors * (w + sizeof("$#255")) + sizeof("-");
+	size_t begin = SIXEL_COLORS * SIXEL_REGISTER_MAX + sizeof("\033P9;1q\"1;1;2147483647;2147483647");
+
+	s->w = w;
+	s->h = h;
+	s->colors = colors;
+	s->nused = 0;
+
+	s->cols = malloc((size_t)colors * w * sizeof(*s->cols));
+	s->ncols = calloc(colors, sizeof(*s->ncols));
+	s->used = malloc(colors * sizeof(*s->used));
+	s->buf = malloc(band > begin ? band : begin);
+	if (s->cols == NULL || s->ncols == NULL || s->used == NULL || s->buf == NULL) {
+		perror("sixel_init: malloc");
+		exit(1);
+	}
+}
+
+/*
+ * Start a picture: its size, with square pixels, and the registers.
+ */
+void sixel_begin(struct sixel *s, int fd)
+{
+	long sum[SIXEL_COLORS][3] = { { 0 } };
+	int count[SIXEL_COLORS] = { 0 };
+	const unsigned char *rgb;
+	char *p = s->buf;
+	size_t len;
+	int i, c, k;
+
+	for (i = 0; i < SIXEL_COLORS; i++) {
+		c = i * s->colors / SIXEL_COLORS;
+		rgb = rgb_color(i);
+		for (k = 0; k < 3; k++)
+			sum[c][k] += rgb[k];
+		count[c]++;
+	}
+
+	p += sprintf(p, "\033P9;1q\"1;1;%d;%d", s->w, s->h);
+	for (c = 0; c < s->colors; c++) {
+		/* Registers are in percent */
+		p += sprintf(p, "#%d;2", c);
+		for (k = 0; k < 3; k++)
+			p += sprintf(p, ";%ld", (sum[c][k] * 100 + 255 * count[c] / 2) / (255 * count[c]));
+	}
+
+	len = p - s->buf;
+	if (insist_write(fd, s->buf, len) != len) {
+		perror("sixel_begin: write");
+		exit(1);
+	}
+}
+
+/*
+ * Append n times character ch, as a repeat if that is shorter.
+ */
+static char *put_run(char *p, char ch, int n)
+{
+	if (n > 3)
+		return p + sprintf(p, "!%d%c", n, ch);
+	while (n-- > 0)
+		*p++ = ch;
+	return p;
+}
+
+/*
+ * Draw the next band, n rows of w palette colors in band[],
+ * n is SIXEL_BAND but for the last band of the picture.
+ */
+void sixel_band(struct sixel *s, int fd, const int band[], int n)
+{
+	char *p = s->buf;
+	size_t len;
+	int reg[SIXEL_BAND];
+	int r, k, x, c, i, j, bits, done, run, *cols;
+
+	for (x = 0; x < s->w; x++) {
+		for (r = 0; r < n; r++)
+			reg[r] = band[r * s->w + x] * s->colors / SIXEL_COLORS;
+
+		/* The sixel of every register in the column */
+		for (r = 0, done = 0; r < n; r++) {
+			if (done & (1 << r))
+				continue;
+			c = reg[r];
+			for (k = r, bits = 0; k < n; k++)
+				if (reg[k] == c)
+					bits |= 1 << k;
+			done |= bits;
+
+			if (s->ncols[c] == 0)
+				s->used[s->nused++] = c;
+			s->cols[(size_t)c * s->w + s->ncols[c]++] = x << 6 | bits;
+		}
+	}
+
+	for (i = 0; i < s->nused; i++) {
+		c = s->used[i];
+		cols = &s->cols[(size_t)c * s->w];
+		if (i > 0)
+			*p++ = '$';
+		p += sprintf(p, "#%d", c);
+
+		/* Runs of neighbouring columns with the same sixel, and the gaps in between */
+		for (j = 0, x = 0; j < s->ncols[c]; j += run) {
+			for (run = 1; j + run < s->ncols[c] && cols[j + run] == cols[j] + (run << 6); run++)
+				;
+			p = put_run(p, '?', (cols[j] >> 6) - x);
+			p = put_run(p, '?' + (cols[j] & 63), run);
+			x = (cols[j] >> 6) + run;
+		}
+		s->ncols[c] = 0;
+	}
+	*p++ = '-';
+	s->nused = 0;
+
+	len = p - s->buf;
+	if (insist_write(fd, s->buf, len) != len) {
+		perror("sixel_band: write");
+		exit(1);
+	}
+}
+
+/*
+ * Done with the picture: end the DCS string, and the line.
+ */
+void sixel_end(struct sixel *s, int fd)
+{
+	if (insist_write(fd, "\033\\\n", 3) != 3) {
+		perror("sixel_end: write");
+		exit(1);
+	}
+}
+
+void sixel_free(struct sixel *s)
+{
+	free(s->cols);
+	free(s->ncols);
+	free(s->used);
+	free(s->buf);
+}
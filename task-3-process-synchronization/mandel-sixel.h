@@ -0,0 +1,40 @@
+/*
+ * mandel-sixel.h
+ *
+ * Sixel graphics output at the terminal, at full pixel resolution,
+ * for terminals that support it.
+ *
+ */
+
+#ifndef MANDEL_SIXEL_H__
+#define MANDEL_SIXEL_H__
+
+/* Color registers, at most one per palette entry */
+#define SIXEL_COLORS 256
+
+/* Pixel rows per band, one sixel character high */
+#define SIXEL_BAND 6
+
+/* Size of the picture unless -s says otherwise */
+#define SIXEL_WIDTH 640
+#define SIXEL_HEIGHT 480
+
+struct sixel {
+	int w, h;              /* size of the picture, in pixels */
+	int colors;            /* color registers the palette is reduced to */
+	int *cols;             /* columns of every register in the band, in order, w each,
+	                          as column << 6 | its sixel */
+	int *ncols;            /* number of columns of every register in the band */
+	int *used;             /* the registers used in the band, in order of appearance */
+	int nused;
+	char *buf;             /* output of a band, written at once */
+};
+
+/* Function prototypes */
+void sixel_init(struct sixel *s, int w, int h, int colors);
+void sixel_begin(struct sixel *s, int fd);
+void sixel_band(struct sixel *s, int fd, const int band[], int n);
+void sixel_end(struct sixel *s, int fd);
+void sixel_free(struct sixel *s);
+
+#endif /* MANDEL_SIXEL_H__ */
@@ -0,0 +1,160 @@
+/*
+ * mandel-term.c
+ *
+ * Truecolor output at the terminal.
+ *
+ * Every character cell is an upper half block, U+2580, whose
+ * foreground color is the upper pixel and background color the lower
+ * one, so a terminal row shows two rows of square-ish pixels in
+ * 24-bit color.
+ *
+ * The first frame is written row after row, like any other output.
+ * The screen remembers what every cell shows, and later frames only
+ * move the cursor, relative to where it is, to the cells that changed
+ * and redraw those. Colors are only set when they change, too.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mandel-lib.h"
+#include "mandel-term.h"
+
+/* U+2580 UPPER HALF BLOCK, in UTF-8 */
+#define UPPER_HALF "\xe2\x96\x80"
+
+/*
+ * Worst case output for a cell: moving the cursor there,
+ * both colors, and the block itself.
+ */
+#define TERM_CELL_MAX (2 * sizeof("\r\033[2147483647C") + \
+	2 * sizeof("\033[38;2;255;255;255m") + sizeof(UPPER_HALF))
+
+void term_init(struct term_screen *t, int w, int rows)
+{
+	int i;
+
+	t->w = w;
+	t->rows = rows;
+	t->frames = 0;
+	t->row = t->col = 0;
+	t->fg = t->bg = -1;
+
+	t->prev = malloc(2 * (size_t)w * rows * sizeof(*t->prev));
+	t->buf = malloc(w * TERM_CELL_MAX + sizeof("\033[0m\r\n"));
+	if (t->prev == NULL || t->buf == NULL) {
+		perror("term_init: malloc");
+		exit(1);
+	}
+	for (i = 0; i < 2 * w * rows; i++)
+		t->prev[i] = -1;
+}
+
+/*
+ * Move the cursor to cell (row, col), return the end of the output.
+ */
+static char *move_to(struct term_screen *t, char *p, int row, int col)
+{
+	if (row > t->row)
+		p += sprintf(p, "\033[%dB", row - t->row);
+	else if (row < t->row)
+		p += sprintf(p, "\033[%dA", t->row - row);
+
+	/* After the last column the cursor is not where we count it, go back to 0 */
+	if (col < t->col) {
+		*p++ = '\r';
+		t->col = 0;
+	}
+	if (col > t->col)
+		p += sprintf(p, "\033[%dC", col - t->col);
+
+	t->row = row;
+	t->col = col;
+	return p;
+}
+
+/*
+ * Set the foreground (sgr 38) or background (sgr 48) to palette color val.
+ */
+static char *set_color(char *p, int sgr, int val)
+{
+	const unsigned char *rgb = rgb_color(val);
+
+	return p + sprintf(p, "\033[%d;2;%d;%d;%dm", sgr, rgb[0], rgb[1], rgb[2]);
+}
+
+/*
+ * Draw cell row row of the frame, from the palette colors
+ * of the pixels in its upper half, top[], and lower half, bottom[].
+ * Rows of the first frame must be drawn in order.
+ */
+void term_draw_row(struct term_screen *t, int fd, int row, const int top[], const int bottom[])
+{
+	char *p = t->buf;
+	size_t len;
+	int i, *cell;
+
+	for (i = 0; i < t->w; i++) {
+		cell = &t->prev[2 * ((size_t)row * t->w + i)];
+		if (cell[0] == top[i] && cell[1] == bottom[i])
+			continue;
+
+		p = move_to(t, p, row, i);
+		if (top[i] != t->fg) {
+			p = set_color(p, 38, top[i]);
+			t->fg = top[i];
+		}
+		if (bottom[i] != t->bg) {
+			p = set_color(p, 48, bottom[i]);
+			t->bg = bottom[i];
+		}
+		memcpy(p, UPPER_HALF, sizeof(UPPER_HALF) - 1);
+		p += sizeof(UPPER_HALF) - 1;
+		t->col++;
+
+		cell[0] = top[i];
+		cell[1] = bottom[i];
+	}
+
+	/* The first frame scrolls into place, without the colors bleeding into new lines */
+	if (t->frames == 0) {
+		p += sprintf(p, "\033[0m\r\n");
+		t->fg = t->bg = -1;
+		t->row++;
+		t->col = 0;
+	}
+
+	len = p - t->buf;
+	if (len > 0 && insist_write(fd, t->buf, len) != len) {
+		perror("term_draw_row: write");
+		exit(1);
+	}
+}
+
+/*
+ * Done with a frame: leave the cursor on the line below the picture.
+ */
+void term_end_frame(struct term_screen *t, int fd)
+{
+	char buf[2 * TERM_CELL_MAX], *p;
+	size_t len;
+
+	p = move_to(t, buf, t->rows, 0);
+	p += sprintf(p, "\033[0m");
+	t->fg = t->bg = -1;
+	t->frames++;
+
+	len = p - buf;
+	if (insist_write(fd, buf, len) != len) {
+		perror("term_end_frame: write");
+		exit(1);
+	}
+}
+
+void term_free(struct term_screen *t)
+{
+	free(t->prev);
+	free(t->buf);
+}
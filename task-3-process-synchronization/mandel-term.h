@@ -0,0 +1,27 @@
+/*
+ * mandel-term.h
+ *
+ * Truecolor output at the terminal, two pixels per character cell,
+ * redrawing only the cells that changed since the previous frame.
+ *
+ */
+
+#ifndef MANDEL_TERM_H__
+#define MANDEL_TERM_H__
+
+struct term_screen {
+	int w, rows;           /* size of the picture, in cells */
+	int frames;            /* frames drawn so far */
+	int *prev;             /* upper and lower palette index of every cell, -1 if unknown */
+	int row, col;          /* cursor position, relative to the upper left cell */
+	int fg, bg;            /* colors currently set, -1 if unknown */
+	char *buf;             /* output of a row, written at once */
+};
+
+/* Function prototypes */
+void term_init(struct term_screen *t, int w, int rows);
+void term_draw_row(struct term_screen *t, int fd, int row, const int top[], const int bottom[]);
+void term_end_frame(struct term_screen *t, int fd);
+void term_free(struct term_screen *t);
+
+#endif /* MANDEL_TERM_H__ */
@@ -11,16 +11,38 @@
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <termios.h>
 
 #include "mandel-lib.h"
+#include "mandel-image.h"
+#include "mandel-job.h"
+#include "mandel-orbits.h"
+#include "mandel-deep.h"
+#include "mandel-term.h"
+#include "mandel-sixel.h"
+#include "mandel-daemon.h"
+#include "mandel-anim.h"
+#include "mandel-pyramid.h"
 #include "proc-common.h"
 #include "pipesem.h"
 
+/* Default maximum number of iterations per point, see -i */
 #define MANDEL_MAX_ITERATION 100000
 
+/* Default number of worker processes */
 #define NCHILDREN 5
 
+#define STR_(x) #x
+#define STR(x) STR_(x)
 
 
 /***************************
@@ -28,7 +50,8 @@
  ***************************/
 
 /*
- * Output at the terminal is is x_chars wide by y_chars long
+ * Output at the terminal is is x_chars wide by y_chars long,
+ * or an image of x_chars x y_chars pixels.
 */
 int y_chars = 50;
 int x_chars = 130;
@@ -47,134 +70,2046 @@ double ymin = -1.0, ymax = 1.0;
 double xstep;
 double ystep;
 
+/*
+ * All of the above, as the render library takes it, see setup_view().
+ */
+struct mandel_params params;
+
+/*
+ * Alternatively, the view can be given as a center and the half-width
+ * (radius) of the x range. The center is kept in double-double precision
+ * for deep zooms.
+ */
+int use_view = 0;
+dd view_cx, view_cy;
+double view_r;
+
+/*
+ * Deep zoom mode. Points are computed by perturbation around the
+ * reference orbit of the center of the view, from their offset
+ * to the center.
+ */
+int use_deep = 0;
+struct mandel_deep deep;
+
+/*
+ * Julia set mode, see -j: the orbit of every point z starts at z,
+ * with c = julia_cx + i julia_cy fixed.
+ */
+int use_julia = 0;
+double julia_cx, julia_cy;
+
+/*
+ * Symmetry. The Mandelbrot Set is symmetric about the real axis,
+ * Julia sets are symmetric about the origin. If the rows of the view
+ * fall on each other's mirror images, row sym_rows - line mirrors
+ * line. For Julia sets the columns must do the same, and point i of
+ * a row mirrors point sym_cols - i of the other.
+ * Then only one row of each pair is computed, and the other is copied.
+ * This needs the rows in memory, so it is done with a framebuffer
+ * or an image file only. -1 means no symmetry.
+ */
+int use_symmetry = 1;
+int sym_rows = -1, sym_cols = -1;
+
+/*
+ * Arithmetic for the points: MANDEL_FLOAT, MANDEL_DOUBLE or MANDEL_DEEP,
+ * or 0 to pick the cheapest one that is accurate enough for the
+ * pixel step of the view. prec is what setup_view() settled on.
+ */
+int precision = 0;
+int prec;
+
+/*
+ * Points that have not escaped after max_iter iterations
+ * are taken to be inside the set.
+ */
+int max_iter = MANDEL_MAX_ITERATION;
+
+/*
+ * How iteration counts are turned into palette colors, see -C.
+ * It only applies on output, so it can change between frames.
+ */
+int color_map = MANDEL_COLOR_CLAMP;
+
+/*
+ * The workers: nworkers forked children, or threads of this process
+ * if use_threads is set. Threads default to one per online CPU.
+ */
+int use_threads = 0;
+int nworkers = 0;
+
+/*
+ * A worker process that dies without passing the token on, or without
+ * storing its rows, leaves the parent and the other workers waiting
+ * for it forever. So while they depend on each other, the parent gives
+ * up on the frame from SIGCHLD as soon as a worker does not exit
+ * normally. worker_pids[] are the children of the frame.
+ */
+pid_t *worker_pids;
+
+/*
+ * Work counters, one slot per worker, in a shared memory area
+ * so that the parent can report them when the frame is done,
+ * along with the CPU time each worker was busy for, and the
+ * wall clock time of the whole frame.
+ * With bench_report set, the report is one line of JSON.
+ */
+struct mandel_stats *stats;
+double *busy;
+double wall_time;
+int bench_report = 0;
+
+/*
+ * Autotuning. The best worker count, chunk size and kernel found
+ * by -A are saved to a profile, loaded by every later run;
+ * command line options still override it.
+ * quiet suppresses all reporting during the trial renders.
+ */
+#define AUTOTUNE_WIDTH  640
+#define AUTOTUNE_HEIGHT 480
+#define AUTOTUNE_RUNS   3
+
+int quiet = 0;
+
+/*
+ * Work distribution. With chunk == 0 worker i draws lines
+ * i, i + nworkers, i + 2 * nworkers, ... Otherwise workers claim
+ * the next chunk lines from the shared counter *next_line as soon as
+ * they are done with their previous chunk.
+ */
+int chunk = 0;
+int *next_line;
+
+/*
+ * Cost map. Every render records the CPU time and the iterations
+ * each line took, and saves them to $MANDEL_COSTMAP or ~/.mandel-costmap.
+ * If the next render with chunk == 0 overlaps that view, its lines are
+ * split into cost_chunks chunks of equal estimated cost instead,
+ * COST_CHUNKS per worker, and worker i draws chunks i, i + nworkers, ...
+ * Chunks longer than COST_MAX_LINES are cut further, as a worker holds
+ * all lines of a chunk until its turn to output them.
+ * cost_bounds[k] is the first line of chunk k. With -K, renders
+ * neither use nor save the cost map, and do not depend on earlier ones.
+ */
+#define COST_CHUNKS 4
+#define COST_MAX_LINES 64
+
+int use_costmap = 1;
+double *line_cost;
+unsigned long *line_iters;
+int cost_chunks = 0;
+int *cost_bounds;
+
+/*
+ * Framebuffer mode. Workers compute lines straight into a shared
+ * framebuffer, set row_ready[line] and signal rows_done. The parent is
+ * the only one writing to the terminal, streaming rows out in order as
+ * they become ready, so computing never waits for output ordering.
+ * The framebuffer holds iteration counts, and the parent colors rows
+ * as it outputs them. It is kept until the next frame, so the frame
+ * can be output again in other colors without computing it again.
+ *
+ * Otherwise, workers output their lines themselves, passing a token
+ * around the ring of semaphores sem[0..nworkers-1]. sem[nworkers]
+ * is signaled by every worker when it is done.
+ */
+int use_framebuffer = 0;
+int *framebuffer;
+int *row_ready;
+struct pipesem rows_done;
+struct pipesem *sem;
+
+/*
+ * Saved orbits, in interactive mode. Next to the counts in the
+ * framebuffer, orbit_zx and orbit_zy keep the z every point stopped at,
+ * from a frame with orbits_max iterations, or 0 if there is none.
+ * If the next frame only raises max_iter, the points that ran out of
+ * iterations go on from there, and no other point is computed.
+ * Mariani-Silver fills points without an orbit, and deep zoom orbits
+ * are offsets, so neither saves them.
+ * With -R, the counts and orbits of an image file are kept in a file
+ * next to it instead, see mandel-orbits.c, for the next run to go on
+ * from. orbit_iter has the counts, the framebuffer or that file.
+ */
+int use_orbits = 0;
+double *orbit_zx, *orbit_zy;
+int *orbit_iter;
+int orbits_max = 0;
+int use_orbit_file = 0;
+struct mandel_orbits orbits;
+
+/*
+ * Mariani-Silver mode. The image is cut into MS_TILE x MS_TILE tiles,
+ * which workers claim from the shared counter *next_tile. tiles_done[r]
+ * counts the finished tiles in tile row r; whoever finishes the last one
+ * marks its lines ready in the framebuffer.
+ */
+#define MS_TILE 16
+#define MS_MIN  4
+
+int use_ms = 0;
+int *next_tile;
+int *tiles_done;
+
+/*
+ * Truecolor output at the terminal, see mandel-term.c. Every cell shows
+ * two pixels, so y_chars is twice the number of terminal rows, and the
+ * framebuffer holds palette colors instead of xterm colors.
+ * In interactive mode keys move the view, and every frame only redraws
+ * the cells that changed.
+ */
+int use_truecolor = 0;
+struct term_screen screen;
+int interactive = 0;
+struct termios saved_tty;
+
+/*
+ * Sixel output at the terminal, see mandel-sixel.c. A pixel is a pixel,
+ * with sixel_colors color registers, and every band of six rows is
+ * drawn as soon as its rows are ready.
+ */
+int use_sixel = 0;
+int sixel_colors = SIXEL_COLORS;
+struct sixel sixel;
+
+/*
+ * Image file mode. Instead of the terminal, the output is an image file
+ * mapped into memory, and workers store their pixels into it directly.
+ */
+int use_image = 0;
+const char *image_path;
+int image_fmt = IMAGE_PPM;
+struct mandel_image image;
+
+/*
+ * Checkpointed jobs, see mandel-job.c. Which tiles of the image are
+ * done is kept in a bitmap file next to it, and a job run again skips
+ * them. A tile is a line, or a tile of Mariani-Silver rendering.
+ */
+int use_job = 0;
+struct mandel_job job;
+int job_resumed;
+
+/*
+ * Stream mode, for images on stdout or a pipe, which cannot be mapped.
+ * Workers compute strips of chunk lines, STREAM_LINES by default,
+ * encode them, and write them to stream_fd in order, passing the token
+ * around the ring of semaphores like for the terminal. Only the strips
+ * being worked on are in memory, however tall the image.
+ */
+#define STREAM_LINES 16
+
+int use_stream = 0;
+int stream_fd;
+size_t stream_bpp;
+
+/*
+ * Read a clock, in seconds.
+ */
+double cpu_time(clockid_t clock)
+{
+	struct timespec ts;
+
+	if (clock_gettime(clock, &ts) < 0) {
+		perror("cpu_time: clock_gettime");
+		exit(1);
+	}
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * This function computes the iteration counts of n points
+ * of a line, starting at column x.
+ * Work counters are added to st.
+ */
+void compute_mandel_span(int line, int x, int n, int iter[], struct mandel_stats *st)
+{
+	size_t at = (size_t)line * x_chars + x;
+
+	if (!use_orbits) {
+		mandel_render_span(&params, line, x, n, iter, st);
+		return;
+	}
+
+	/* Go on from the counts of the last frame */
+	if (params.from > 0)
+		memcpy(iter, &orbit_iter[at], n * sizeof(*iter));
+	mandel_render_span_orbits(&params, line, x, n, iter, &orbit_zx[at], &orbit_zy[at], st);
+}
+
+/*
+ * This function computes the iteration counts
+ * of the x_chars points of a line.
+ * Work counters are added to st.
+ */
+void compute_mandel_iterations(int line, int iter[], struct mandel_stats *st)
+{
+	unsigned long before = st->iterations;
+	double start = cpu_time(CLOCK_THREAD_CPUTIME_ID);
+
+	compute_mandel_span(line, 0, x_chars, iter, st);
+
+	/* Record what the line cost, for the cost map */
+	line_cost[line] = cpu_time(CLOCK_THREAD_CPUTIME_ID) - start;
+	line_iters[line] = st->iterations - before;
+}
+
+/*
+ * The color of a point with iteration count val on the terminal:
+ * its xterm color, or its palette color for truecolor and sixel output.
+ */
+int point_color(int val)
+{
+	val = mandel_color_index(color_map, val, max_iter);
+	return (use_truecolor || use_sixel) ? val : xterm_color(val);
+}
+
+/*
+ * Turn the iteration counts of a line into x_chars color values.
+ * iter and color_val may be the same array.
+ */
+void color_mandel_line(const int iter[], int color_val[])
+{
+	int n;
+
+	for (n = 0; n < x_chars; n++)
+		color_val[n] = point_color(iter[n]);
+}
+
 /*
  * This function computes a line of output
  * as an array of x_char color values.
+ * Work counters are added to st.
+ */
+void compute_mandel_line(int line, int color_val[], struct mandel_stats *st)
+{
+	compute_mandel_iterations(line, color_val, st);
+	color_mandel_line(color_val, color_val);
+}
+
+/*
+ * The row that mirrors line, if line is the one of the pair
+ * that gets computed, else -1.
+ */
+int mirror_row(int line)
+{
+	int m = sym_rows - line;
+
+	return (sym_rows >= 0 && m > line && m < y_chars) ? m : -1;
+}
+
+/*
+ * Whether line is copied from its mirror image instead of computed.
+ */
+int mirrored_row(int line)
+{
+	int m = sym_rows - line;
+
+	return sym_rows >= 0 && m >= 0 && m < line;
+}
+
+/*
+ * In Julia sets, points lo to hi of a row have their mirror image,
+ * point sym_cols - i, in the view.
+ */
+void mirror_cols(int *lo, int *hi)
+{
+	*lo = (sym_cols - (x_chars - 1) > 0) ? sym_cols - (x_chars - 1) : 0;
+	*hi = (sym_cols < x_chars - 1) ? sym_cols : x_chars - 1;
+}
+
+/*
+ * Fill mir[] with the iteration counts of the row that mirrors line,
+ * given the counts iter[] of line. Points whose mirror image
+ * is outside the view are computed.
+ */
+void mirror_iterations(int line, const int iter[], int mir[], struct mandel_stats *st)
+{
+	int i, lo, hi;
+
+	if (!use_julia) {
+		memcpy(mir, iter, x_chars * sizeof(*mir));
+		st->mirrored += x_chars;
+		return;
+	}
+
+	mirror_cols(&lo, &hi);
+	for (i = lo; i <= hi; i++)
+		mir[i] = iter[sym_cols - i];
+	st->mirrored += hi - lo + 1;
+
+	if (lo > 0)
+		compute_mandel_span(mirror_row(line), 0, lo, mir, st);
+	if (hi < x_chars - 1)
+		compute_mandel_span(mirror_row(line), hi + 1, x_chars - 1 - hi, mir + hi + 1, st);
+}
+
+/*
+ * The same for the saved orbits: the mirror image of an orbit is
+ * its complex conjugate, or -z in Julia sets.
+ */
+void mirror_orbits(int line)
+{
+	size_t a = (size_t)line * x_chars, b = (size_t)mirror_row(line) * x_chars;
+	int i, lo, hi;
+
+	if (!use_julia) {
+		for (i = 0; i < x_chars; i++) {
+			orbit_zx[b + i] = orbit_zx[a + i];
+			orbit_zy[b + i] = -orbit_zy[a + i];
+		}
+		return;
+	}
+
+	mirror_cols(&lo, &hi);
+	for (i = lo; i <= hi; i++) {
+		orbit_zx[b + i] = -orbit_zx[a + sym_cols - i];
+		orbit_zy[b + i] = -orbit_zy[a + sym_cols - i];
+	}
+}
+
+/*
+ * Put the iteration counts of a row where they belong: in the image file,
+ * and with its orbits, or in the framebuffer, for the parent to output.
+ */
+void store_row(int line, const int iter[])
+{
+	if (use_image) {
+		if (use_orbits)
+			memcpy(&orbit_iter[(size_t)line * x_chars], iter, x_chars * sizeof(*orbit_iter));
+		image_store(&image, line, 0, iter, x_chars);
+		return;
+	}
+
+	memcpy(&framebuffer[(size_t)line * x_chars], iter, x_chars * sizeof(*framebuffer));
+	__atomic_store_n(&row_ready[line], 1, __ATOMIC_RELEASE);
+	pipesem_signal(&rows_done);
+}
+
+/*
+ * Mariani-Silver rendering.
+ *
+ * The Mandelbrot Set is connected, so if the whole border of a rectangle
+ * has the same iteration count, the inside is assumed to have it as well,
+ * and is filled without computing it. Otherwise the rectangle is split
+ * in two along its longer side, and each half is handled the same way.
+ *
+ * All functions below work on the iteration counts it[] of a single tile,
+ * whose upper left pixel is (tx, ty), stored row by row with stride w.
+ */
+void ms_compute_row(int *it, int w, int tx, int ty, int r, int c, int n,
+	struct mandel_stats *st)
+{
+	if (n > 0)
+		compute_mandel_span(ty + r, tx + c, n, &it[r * w + c], st);
+}
+
+void ms_compute_col(int *it, int w, int tx, int ty, int r, int c, int n,
+	struct mandel_stats *st)
+{
+	for (; n > 0; r++, n--)
+		compute_mandel_span(ty + r, tx + c, 1, &it[r * w + c], st);
+}
+
+/*
+ * Handle the rectangle of rw x rh pixels at (x, y) within the tile.
+ * Its border has already been computed.
+ */
+void ms_rect(int *it, int w, int tx, int ty, int x, int y, int rw, int rh,
+	struct mandel_stats *st)
+{
+	int r, c, m, val, uniform;
+
+	if (rw <= 2 || rh <= 2)
+		return;
+
+	val = it[y * w + x];
+	uniform = 1;
+	for (c = x; c < x + rw && uniform; c++)
+		uniform = (it[y * w + c] == val && it[(y + rh - 1) * w + c] == val);
+	for (r = y + 1; r < y + rh - 1 && uniform; r++)
+		uniform = (it[r * w + x] == val && it[r * w + x + rw - 1] == val);
+
+	if (uniform) {
+		for (r = y + 1; r < y + rh - 1; r++)
+			for (c = x + 1; c < x + rw - 1; c++)
+				it[r * w + c] = val;
+		st->filled += (rw - 2) * (rh - 2);
+		return;
+	}
+
+	if (rw <= MS_MIN || rh <= MS_MIN) {
+		/* Too small to be worth splitting, compute the inside */
+		for (r = y + 1; r < y + rh - 1; r++)
+			ms_compute_row(it, w, tx, ty, r, x + 1, rw - 2, st);
+		return;
+	}
+
+	if (rw >= rh) {
+		m = x + rw / 2;
+		ms_compute_col(it, w, tx, ty, y + 1, m, rh - 2, st);
+		ms_rect(it, w, tx, ty, x, y, m - x + 1, rh, st);
+		ms_rect(it, w, tx, ty, m, y, x + rw - m, rh, st);
+	} else {
+		m = y + rh / 2;
+		ms_compute_row(it, w, tx, ty, m, x + 1, rw - 2, st);
+		ms_rect(it, w, tx, ty, x, y, rw, m - y + 1, st);
+		ms_rect(it, w, tx, ty, x, m, rw, y + rh - m, st);
+	}
+}
+
+/*
+ * Render tile number tile into the image, or into the framebuffer.
+ * When it is the last tile of its row of tiles to finish,
+ * the lines it covers are ready for output.
+ */
+void ms_tile(int tile, struct mandel_stats *st)
+{
+	int tiles_x = (x_chars + MS_TILE - 1) / MS_TILE;
+	int tx = (tile % tiles_x) * MS_TILE;
+	int ty = (tile / tiles_x) * MS_TILE;
+	int w = (tx + MS_TILE <= x_chars) ? MS_TILE : x_chars - tx;
+	int h = (ty + MS_TILE <= y_chars) ? MS_TILE : y_chars - ty;
+	int it[MS_TILE * MS_TILE];
+	int r;
+
+	/* The border of the tile, then the rest by subdivision */
+	ms_compute_row(it, w, tx, ty, 0, 0, w, st);
+	if (h > 1)
+		ms_compute_row(it, w, tx, ty, h - 1, 0, w, st);
+	ms_compute_col(it, w, tx, ty, 1, 0, h - 2, st);
+	if (w > 1)
+		ms_compute_col(it, w, tx, ty, 1, w - 1, h - 2, st);
+	ms_rect(it, w, tx, ty, 0, 0, w, h, st);
+
+	if (use_image) {
+		for (r = 0; r < h; r++)
+			image_store(&image, ty + r, tx, &it[r * w], w);
+		return;
+	}
+
+	for (r = 0; r < h; r++)
+		memcpy(&framebuffer[(ty + r) * x_chars + tx], &it[r * w], w * sizeof(*framebuffer));
+
+	if (__sync_add_and_fetch(&tiles_done[tile / tiles_x], 1) == tiles_x) {
+		for (r = ty; r < ty + h; r++) {
+			__atomic_store_n(&row_ready[r], 1, __ATOMIC_RELEASE);
+			pipesem_signal(&rows_done);
+		}
+	}
+}
+
+/*
+ * This function outputs an array of x_char color values
+ * to a 256-color xterm, with a single write.
+ */
+void output_mandel_line(int fd, int color_val[])
+{
+	char buf[XTERM_LINE_MAX(x_chars)];
+	size_t len;
+
+	len = xterm_encode_line(buf, color_val, x_chars);
+	if (insist_write(fd, buf, len) != len) {
+		perror("output_mandel_line: write line");
+		exit(1);
+	}
+}
+
+/*
+ * Compute count lines starting at first, then output them in order.
+ * The lines are the token-th piece of the output: wait for our turn
+ * on sem[token % nworkers], and pass it on to the next piece.
+ */
+void compute_and_output_mandel_lines(int fd, int first, int count, int token,
+	struct mandel_stats *st)
+{
+	/*
+	 * A temporary array, used to hold color values for the lines being drawn,
+	 * on the heap: chunks can be large, see -c and the cost map
+	 */
+	int *color_val;
+	int i;
+
+	if ((color_val = malloc((size_t)count * x_chars * sizeof(*color_val))) == NULL) {
+		perror("compute_and_output_mandel_lines: malloc");
+		exit(1);
+	}
+	for (i = 0; i < count; i++)
+		compute_mandel_line(first + i, &color_val[(size_t)i * x_chars], st);
+	pipesem_wait(&sem[(token%nworkers)]);
+	for (i = 0; i < count; i++)
+		output_mandel_line(fd, &color_val[(size_t)i * x_chars]);
+	pipesem_signal(&sem[(token+1)%nworkers]);
+	free(color_val);
+}
+
+/*
+ * The same for stream mode: compute count lines starting at first,
+ * encode them into a strip, and write it out on our turn.
+ */
+void compute_and_stream_lines(int fd, int first, int count, int token,
+	struct mandel_stats *st)
+{
+	size_t rowlen = x_chars * stream_bpp;
+	unsigned char *strip;
+	int iter[x_chars];
+	int i;
+
+	if ((strip = malloc(rowlen * count)) == NULL) {
+		perror("compute_and_stream_lines: malloc");
+		exit(1);
+	}
+	for (i = 0; i < count; i++) {
+		compute_mandel_iterations(first + i, iter, st);
+		image_encode(strip + i * rowlen, image_fmt, color_map, max_iter, iter, x_chars);
+	}
+
+	pipesem_wait(&sem[(token%nworkers)]);
+	if (insist_write(fd, (char *)strip, rowlen * count) != rowlen * count) {
+		perror("compute_and_stream_lines: write");
+		exit(1);
+	}
+	pipesem_signal(&sem[(token+1)%nworkers]);
+	free(strip);
+}
+
+/*
+ * Return the first line of the next piece of work for worker i,
+ * or -1 if there is none left, and set *count to its number of lines
+ * and *token to its place in the output order. prev is the token
+ * of the previous piece, or -1.
+ *
+ * In static mode worker i draws lines i, i + nworkers, ...
+ * or chunks i, i + nworkers, ... of the cost map.
+ * In dynamic mode chunks are claimed from the shared counter.
+ */
+int claim_lines(int i, int prev, int *count, int *token)
+{
+	int line;
+
+	if (chunk == 0 && cost_chunks) {
+		*token = (prev < 0) ? i : prev + nworkers;
+		if (*token >= cost_chunks)
+			return -1;
+		*count = cost_bounds[*token + 1] - cost_bounds[*token];
+		return cost_bounds[*token];
+	}
+
+	if (chunk == 0) {
+		line = (prev < 0) ? i : prev + nworkers;
+		*count = 1;
+		*token = line;
+		return (line < y_chars) ? line : -1;
+	}
+
+	line = __sync_fetch_and_add(next_line, chunk);
+	if (line >= y_chars)
+		return -1;
+	*count = (line + chunk <= y_chars) ? chunk : y_chars - line;
+	*token = line / chunk;
+	return line;
+}
+
+/*
+ * The work of worker i, the same for processes and threads.
+ *
+ * Without a framebuffer, the lines are output by the workers themselves,
+ * in order, using the pipesem ring. In dynamic mode chunks are claimed
+ * in increasing order and every worker holds at most one chunk at a time.
+ * So when chunk k + nworkers is claimed, chunk k has already been output,
+ * and a ring of nworkers semaphores indexed by chunk number still works.
+ * Chunks of the cost map go round the workers like lines in static mode.
+ */
+void do_work(int i)
+{
+	int line, count, token, n, m, tile;
+	int ntiles = ((x_chars + MS_TILE - 1) / MS_TILE) * ((y_chars + MS_TILE - 1) / MS_TILE);
+
+	if (use_ms) {
+		while ((tile = __sync_fetch_and_add(next_tile, 1)) < ntiles) {
+			if (use_job && job_done(&job, tile))
+				continue;
+			ms_tile(tile, &stats[i]);
+			if (use_job)
+				job_mark(&job, tile);
+		}
+		return;
+	}
+
+	for (token = -1; (line = claim_lines(i, token, &count, &token)) >= 0; ) {
+		if (use_stream) {
+			compute_and_stream_lines(stream_fd, line, count, token, &stats[i]);
+			continue;
+		}
+		if (!use_framebuffer && !use_image) {
+			compute_and_output_mandel_lines(1, line, count, token, &stats[i]);
+			continue;
+		}
+
+		/* Rows in memory: compute each pair of mirrored rows once */
+		for (n = line; n < line + count; n++) {
+			int iter[x_chars], mir[x_chars];
+
+			if (mirrored_row(n))
+				continue;
+
+			/*
+			 * A job may have crashed after marking n but not its mirror,
+			 * or have run without symmetry: then the image only has the
+			 * counts as colors, so compute n again to rebuild the mirror.
+			 */
+			m = mirror_row(n);
+			if (use_job && job_done(&job, n) && (m < 0 || job_done(&job, m)))
+				continue;
+			compute_mandel_iterations(n, iter, &stats[i]);
+			store_row(n, iter);
+			if (m >= 0) {
+				mirror_iterations(n, iter, mir, &stats[i]);
+				if (use_orbits)
+					mirror_orbits(n);
+				store_row(m, mir);
+				line_cost[m] = line_cost[n];
+				line_iters[m] = line_iters[n];
+			}
+			/* The mirror first: n marked done means that both are */
+			if (use_job) {
+				if (m >= 0)
+					job_mark(&job, m);
+				job_mark(&job, n);
+			}
+		}
+	}
+
+}
+
+/*
+ * Worker i: do its share of the work and record how much
+ * CPU time that took. Every worker is a single thread, so the
+ * CPU time of the thread is the CPU time of the worker.
+ */
+void worker(int i)
+{
+	double start = cpu_time(CLOCK_THREAD_CPUTIME_ID);
+
+	do_work(i);
+	busy[i] = cpu_time(CLOCK_THREAD_CPUTIME_ID) - start;
+
+	if (!use_framebuffer && !use_image)
+		pipesem_signal(&sem[nworkers]);
+}
+
+void *worker_thread(void *arg)
+{
+	worker((long)arg);
+	return NULL;
+}
+
+/*
+ * Memory shared by all workers. Threads share our address space
+ * anyway, children need a shared mapping created before fork().
+ */
+void *alloc_shared(size_t numbytes)
+{
+	void *p;
+
+	if (!use_threads)
+		return create_shared_memory_area(numbytes);
+
+	p = calloc(1, numbytes);
+	if (p == NULL) {
+		perror("alloc_shared: calloc");
+		exit(1);
+	}
+	return p;
+}
+
+void free_shared(void *p, size_t numbytes)
+{
+	if (use_threads) {
+		free(p);
+		return;
+	}
+	if (munmap(p, numbytes) < 0) {
+		perror("free_shared: munmap");
+		exit(1);
+	}
+}
+
+/*
+ * Wait until row line of the framebuffer is ready.
+ */
+void wait_row(int line)
+{
+	while (!__atomic_load_n(&row_ready[line], __ATOMIC_ACQUIRE))
+		pipesem_wait(&rows_done);
+}
+
+/*
+ * Framebuffer mode: color all rows in order and output them, as soon
+ * as they are ready. Every signal on rows_done means one more row is
+ * ready, so we only ever block while the next row to output is still
+ * being computed. Rows that are ready from the last frame are not
+ * waited for, so this also recolors a finished frame.
+ */
+void emit_framebuffer(int fd)
+{
+	int color_val[2][x_chars];
+	int line;
+
+	if (use_truecolor) {
+		for (line = 0; line < y_chars; line += 2) {
+			wait_row(line);
+			wait_row(line + 1);
+			color_mandel_line(&framebuffer[(size_t)line * x_chars], color_val[0]);
+			color_mandel_line(&framebuffer[(size_t)(line + 1) * x_chars], color_val[1]);
+			term_draw_row(&screen, fd, line / 2, color_val[0], color_val[1]);
+		}
+		term_end_frame(&screen, fd);
+		return;
+	}
+
+	if (use_sixel) {
+		int band[SIXEL_BAND][x_chars];
+		int r, n;
+
+		sixel_begin(&sixel, fd);
+		for (line = 0; line < y_chars; line += SIXEL_BAND) {
+			n = (y_chars - line < SIXEL_BAND) ? y_chars - line : SIXEL_BAND;
+			for (r = 0; r < n; r++) {
+				wait_row(line + r);
+				color_mandel_line(&framebuffer[(size_t)(line + r) * x_chars], band[r]);
+			}
+			sixel_band(&sixel, fd, &band[0][0], n);
+		}
+		sixel_end(&sixel, fd);
+		return;
+	}
+
+	for (line = 0; line < y_chars; line++) {
+		wait_row(line);
+		color_mandel_line(&framebuffer[(size_t)line * x_chars], color_val[0]);
+		output_mandel_line(fd, color_val[0]);
+	}
+}
+
+/*
+ * Release the framebuffer, when there are no more frames.
+ */
+void free_framebuffer(void)
+{
+	if (framebuffer == NULL)
+		return;
+	free_shared(framebuffer, (size_t)y_chars * x_chars * sizeof(*framebuffer));
+	free_shared(row_ready, y_chars * sizeof(*row_ready));
+	framebuffer = NULL;
+	if (orbit_zx != NULL) {
+		free_shared(orbit_zx, (size_t)y_chars * x_chars * sizeof(*orbit_zx));
+		free_shared(orbit_zy, (size_t)y_chars * x_chars * sizeof(*orbit_zy));
+		orbit_zx = orbit_zy = NULL;
+	}
+}
+
+/*
+ * Sum the work counters of all workers and report
+ * how much the interior shortcuts saved in this frame.
+ */
+void report_stats(void)
+{
+	int i;
+	struct mandel_stats total = { 0 };
+
+	for (i = 0; i < nworkers; i++)
+		mandel_stats_add(&total, &stats[i]);
+
+	if (bench_report) {
+		fprintf(stderr, "{\"kernel\":\"%s\",\"precision\":\"%s\",\"backend\":\"%s\","
+			"\"workers\":%d,\"width\":%d,\"height\":%d,\"max_iter\":%d,\"wall\":%.6f,"
+			"\"pixels\":%d,\"points\":%lu,\"iterations\":%lu,"
+			"\"pixels_per_s\":%.0f,\"iterations_per_s\":%.0f,\"busy\":[",
+			mandel_kernel_name(), mandel_precision_name(prec),
+			use_threads ? "threads" : "processes", nworkers,
+			x_chars, y_chars, max_iter, wall_time,
+			x_chars * y_chars, total.points, total.iterations,
+			x_chars * y_chars / wall_time, total.iterations / wall_time);
+		for (i = 0; i < nworkers; i++)
+			fprintf(stderr, "%s%.6f", i ? "," : "", busy[i]);
+		fprintf(stderr, "]}\n");
+		return;
+	}
+
+	fprintf(stderr, "Kernel %s in %s, %d %s: %lu points, %lu iterations\n",
+		mandel_kernel_name(), mandel_precision_name(prec),
+		nworkers, use_threads ? "threads" : "processes",
+		total.points, total.iterations);
+	fprintf(stderr, "Shortcuts: cardioid %lu, bulb %lu, cycle %lu (%.1f%% of points)\n",
+		total.cardioid, total.bulb, total.cycles,
+		total.points ? 100.0 * (total.cardioid + total.bulb + total.cycles) / total.points : 0.0);
+	if (use_ms)
+		fprintf(stderr, "Mariani-Silver: %lu of %d pixels filled without computing\n",
+			total.filled, x_chars * y_chars);
+	if (cost_chunks)
+		fprintf(stderr, "Cost map: lines split into %d chunks by estimated cost\n",
+			cost_chunks);
+	if (sym_rows >= 0)
+		fprintf(stderr, "Symmetry: %lu of %d pixels copied from their mirror image\n",
+			total.mirrored, x_chars * y_chars);
+	if (use_deep)
+		fprintf(stderr, "Deep zoom: reference orbit of %d steps, %lu rebases\n",
+			deep.len, total.rebases);
+	fprintf(stderr, "Wall time %.3fs\n", wall_time);
+}
+
+void sigint_handler(int sig)
+{
+	signal(SIGINT, SIG_IGN);
+	reset_xterm_color(1);
+	if (interactive)
+		tcsetattr(0, TCSANOW, &saved_tty);
+	signal(SIGINT, SIG_DFL);
+	killpg(0, SIGINT);
+}
+
+/*
+ * A worker changed state: if one of worker_pids[] died, kill the
+ * others and give up. Children are only looked at, not reaped,
+ * so that render_frame() still waits for them as usual.
+ */
+void sigchld_handler(int sig)
+{
+	static const char msg[] = "A worker died, giving up on the frame\n";
+	siginfo_t si;
+	int i;
+
+	for (i = 0; i < nworkers; i++) {
+		si.si_pid = 0;
+		if (waitid(P_PID, worker_pids[i], &si, WEXITED | WNOHANG | WNOWAIT) < 0 ||
+		    si.si_pid == 0 || (si.si_code == CLD_EXITED && si.si_status == 0))
+			continue;
+
+		for (i = 0; i < nworkers; i++)
+			kill(worker_pids[i], SIGKILL);
+		reset_xterm_color(1);
+		if (interactive)
+			tcsetattr(0, TCSANOW, &saved_tty);
+		write(2, msg, sizeof(msg) - 1);
+		_exit(1);
+	}
+}
+
+/*
+ * If the image goes to path "-", stdout, or to a pipe or a device,
+ * return the file descriptor to stream it to, else -1.
+ */
+int stream_open(const char *path)
+{
+	struct stat st;
+	int fd;
+
+	if (strcmp(path, "-") == 0)
+		return 1;
+	if (stat(path, &st) < 0 || S_ISREG(st.st_mode))
+		return -1;
+
+	if ((fd = open(path, O_WRONLY)) < 0) {
+		perror("stream_open: open");
+		exit(1);
+	}
+	return fd;
+}
+
+/*
+ * Parse a view given as "cx,cy,r".
+ */
+int parse_view(const char *arg)
+{
+	char *p;
+
+	if (dd_parse(arg, &view_cx, &p) < 0 || *p++ != ',')
+		return -1;
+	if (dd_parse(p, &view_cy, &p) < 0 || *p++ != ',')
+		return -1;
+	view_r = strtod(p, &p);
+	if (*p != '\0' || !(view_r > 0))
+		return -1;
+
+	use_view = 1;
+	return 0;
+}
+
+/*
+ * If v, a pixel index times two, is a whole number k with pairs of
+ * pixels i, k - i in 0 .. n - 1, return k, else -1.
+ */
+int grid_index(double v, int n)
+{
+	double k = round(v);
+
+	if (fabs(v - k) > 1e-6 || k < 1 || k > 2 * n - 3)
+		return -1;
+	return (int)k;
+}
+
+/*
+ * Work out the part of the complex plane covered by each
+ * character or pixel, and the reference orbit for deep zooms.
  */
-void compute_mandel_line(int line, int color_val[])
+void setup_view(void)
 {
+	double mag;
+	int from, mirror;
+
+	if (use_view) {
+		/* Characters on the terminal are about twice as tall as wide */
+		xstep = 2 * view_r / x_chars;
+		ystep = (use_image || use_stream || use_truecolor || use_sixel) ? xstep : 2 * xstep;
+		xmin = view_cx.hi - view_r;
+		xmax = view_cx.hi + view_r;
+		ymin = view_cy.hi - ystep * y_chars / 2;
+		ymax = view_cy.hi + ystep * y_chars / 2;
+	} else {
+		xstep = (xmax - xmin) / x_chars;
+		ystep = (ymax - ymin) / y_chars;
+		view_cx = dd_from_double((xmin + xmax) / 2);
+		view_cy = dd_from_double((ymin + ymax) / 2);
+	}
+
+	/* Orbits that matter stay within |z| <= 2 */
+	mag = fmax(fmax(fabs(xmin), fabs(xmax)), fmax(fabs(ymin), fabs(ymax)));
+	prec = precision;
+	if (!prec)
+		prec = mandel_precision_for(fmin(xstep, ystep), fmax(mag, 2.0), max_iter);
+	/* Perturbation is only implemented for the Mandelbrot Set */
+	if (use_julia && prec == MANDEL_DEEP)
+		prec = MANDEL_DOUBLE;
+	use_deep = (prec == MANDEL_DEEP);
+
+	/*
+	 * Line l is at y = ymax - l * ystep and its mirror -y at line
+	 * 2 * ymax / ystep - l, point i at x = xmin + i * xstep and -x
+	 * at point -2 * xmin / xstep - i. The deep zoom path computes
+	 * offsets from a reference orbit instead, so leave it alone.
+	 * Lines are computed from the mirror line in every mode, with
+	 * or without -S, so copying a line gives the same counts as
+	 * computing it. Points of Julia sets are not: a copied point
+	 * may differ in the last bit of x, and rarely in its count.
+	 */
+	mirror = use_deep ? -1 : grid_index(2 * ymax / ystep, y_chars);
+	sym_rows = sym_cols = -1;
+	if (use_symmetry && !use_deep && !use_ms && (use_framebuffer || use_image)) {
+		sym_rows = mirror;
+		if (use_julia && (sym_cols = grid_index(-2 * xmin / xstep, x_chars)) < 0)
+			sym_rows = -1;
+	}
+
 	/*
-	 * x and y traverse the complex plane.
+	 * Go on from the orbits of the last frame if it was the same view,
+	 * params still has it, with fewer iterations. The kernel has to be
+	 * the same too: float only counts up to MANDEL_FLOAT_MAX_ITER.
 	 */
-	double x, y;
+	use_orbits = (interactive || use_orbit_file) && !use_deep && !use_ms;
+	from = 0;
+	if (interactive && use_orbits && orbits_max > 0 && orbits_max < max_iter &&
+	    params.xmin == xmin && params.ymax == ymax &&
+	    params.xstep == xstep && params.ystep == ystep &&
+	    params.precision == prec && params.julia == use_julia &&
+	    params.julia_cx == julia_cx && params.julia_cy == julia_cy &&
+	    !(prec == MANDEL_FLOAT && max_iter > MANDEL_FLOAT_MAX_ITER))
+		from = orbits_max;
 
-	int n;
-	int val;
+	/* Everything the workers need to compute points */
+	params.width = x_chars;
+	params.height = y_chars;
+	params.xmin = xmin;
+	params.ymax = ymax;
+	params.xstep = xstep;
+	params.ystep = ystep;
+	params.max = max_iter;
+	params.from = from;
+	params.mirror = mirror;
+	params.precision = prec;
+	params.julia = use_julia;
+	params.julia_cx = julia_cx;
+	params.julia_cy = julia_cy;
+	params.deep = NULL;
+
+	if (use_deep) {
+		/* Offsets from the center of the view */
+		params.xmin = -xstep * x_chars / 2;
+		params.ymax = ystep * y_chars / 2;
+		params.deep = &deep;
+		if (deep_reference(&deep, view_cx, view_cy, max_iter) < 0) {
+			perror("setup_view: deep_reference");
+			exit(1);
+		}
+	}
+}
+
+void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-k kernel] [-c chunk] [-K] [-f] [-t] [-T] [-X regs] [-I] [-n workers]\n"
+		"       [-m] [-s WxH] [-o file] [-F format] [-C map] [-v cx,cy,r] [-Z] [-p prec]\n"
+		"       [-j cx,cy] [-S] [-i max] [-b] [-A] [-D socket] [-a file] [-J] [-R]\n"
+		"       [-P level]\n\n"
+		"  -k kernel  escape time kernel: auto, avx512, avx2, sse2 or scalar\n"
+		"  -c chunk   claim chunk lines at a time from a shared counter,\n"
+		"             instead of interleaving lines statically among workers,\n"
+		"             or chunks of equal cost if $MANDEL_COSTMAP or ~/.mandel-costmap,\n"
+		"             saved by every render, covers an overlapping view\n"
+		"  -K         neither use nor save the cost map, see -c\n"
+		"  -f         compute into a shared framebuffer, and have a single\n"
+		"             process output the rows in order as they complete\n"
+		"  -t         use threads instead of processes as workers (implies -f)\n"
+		"  -T         truecolor output, two pixels per character with half blocks,\n"
+		"             on H rows of the terminal for -s WxH (implies -f)\n"
+		"  -X regs    sixel graphics output, a pixel per pixel, -s in pixels, default\n"
+		"             " STR(SIXEL_WIDTH) "x" STR(SIXEL_HEIGHT) ", with the palette reduced to regs color\n"
+		"             registers, " STR(SIXEL_COLORS) " or fewer, like 16 for a VT340 (implies -f)\n"
+		"  -I         interactive: move with h, j, k, l or the arrows, zoom with + and -,\n"
+		"             next color mapping with c, twice the iterations with i,\n"
+		"             quit with q; only the cells that change are redrawn,\n"
+		"             and i only goes on with the points that need it (implies -T)\n"
+		"  -n workers number of workers, default " STR(NCHILDREN) " processes\n"
+		"             or one thread per online CPU\n"
+		"  -m         Mariani-Silver rendering: compute the borders of\n"
+		"             " STR(MS_TILE) "x" STR(MS_TILE) " tiles, fill uniform ones, subdivide the rest\n"
+		"             (implies -f)\n"
+		"  -s WxH     size of the output, in characters or pixels\n"
+		"  -o file    write an image file instead of drawing on the terminal;\n"
+		"             - for stdout, which like pipes gets it in strips of -c lines,\n"
+		"             default " STR(STREAM_LINES) ", in bounded memory\n"
+		"  -F format  image format: ppm (default), pgm, or raw 32-bit iteration counts\n"
+		"  -C map     color mapping of iteration counts: clamp (default) at 255,\n"
+		"             cycle through the palette, or log, spread up to the maximum\n"
+		"  -v cx,cy,r view centered at (cx, cy), with x from cx - r to cx + r\n"
+		"  -Z         deep zoom: perturbation around a double-double reference orbit\n"
+		"  -p prec    arithmetic: float, double, deep (same as -Z), or auto (default),\n"
+		"             the cheapest one that resolves the pixel step of the view,\n"
+		"             float only up to " STR(MANDEL_FLOAT_AUTO_ITER) " iterations\n"
+		"  -j cx,cy   draw the Julia set for c = cx + i cy instead\n"
+		"  -S         do not copy rows from their mirror image in symmetric views\n"
+		"  -i max     maximum number of iterations per point, default " STR(MANDEL_MAX_ITERATION) "\n"
+		"  -b         report statistics as a single line of JSON, for benchmarks\n"
+		"  -A         autotune: find the fastest kernel, worker count and chunk size\n"
+		"             for this machine with trial renders, and save them to\n"
+		"             $MANDEL_PROFILE or ~/.mandel-profile for later runs\n"
+		"  -D socket  serve renders on a Unix domain socket with a pool of -n\n"
+		"             threads; a request is a line like\n"
+		"             \"size=640x480 view=-0.4,0,1.4 iter=1000 format=ppm colors=log\",\n"
+		"             with every key optional, or julia=cx,cy for a Julia set,\n"
+		"             and the reply is the image file\n"
+		"  -a file    render a zoom along the views in file, lines of\n"
+		"             \"cx,cy,r frames\", each reached frames frames after the one\n"
+		"             before, to the image files named by -o, like zoom-%%04d.ppm,\n"
+		"             with a pool of -n threads and several frames in flight\n"
+		"  -J         checkpointed job: keep which lines or tiles of the -o file\n"
+		"             are done in file.done, so that the same command run again\n"
+		"             after a crash goes on from there; removed once complete\n"
+		"  -R         keep the counts and orbits of the -o file in file.orbits,\n"
+		"             so that the same view run again with a larger -i only goes\n"
+		"             on with the points that need it, as i does with -I\n"
+		"  -P level   render a pyramid of " STR(PYRAMID_TILE) "x" STR(PYRAMID_TILE) " map tiles, levels 0 to level,\n"
+		"             of the square view of -v, default all of the set, into\n"
+		"             the directory of -o as z/x/y.ppm, or a .tar file, with a\n"
+		"             pool of -n threads; tiles proven uniform are filled in\n"
+		"             at the levels below without iterating\n",
+		argv0);
+	exit(1);
+}
 
-	/* Find out the y value corresponding to this line */
-	y = ymax - ystep * line;
+/*
+ * The file named by environment variable env, or file name
+ * in the home directory.
+ */
+const char *dotfile_path(const char *env, const char *name)
+{
+	static char path[4096];
+	const char *p;
 
-	/* and iterate for all points on this line */
-	for (x = xmin, n = 0; x <= xmax; x+= xstep, n++) {
+	if ((p = getenv(env)) != NULL)
+		return p;
+	if ((p = getenv("HOME")) == NULL)
+		p = ".";
+	snprintf(path, sizeof(path), "%s/%s", p, name);
+	return path;
+}
 
-		/* Compute the point's color value */
-		val = mandel_iterations_at_point(x, y, MANDEL_MAX_ITERATION);
-		if (val > 255)
-			val = 255;
+/*
+ * Save the cost of every line of this render to the cost map.
+ * The first line describes the view, every other line has the CPU time
+ * and the iterations of a line of output. It is only a hint for
+ * later renders, so failing to save it is not fatal.
+ */
+void save_costmap(void)
+{
+	char tmp[4096 + 8];
+	const char *path = dotfile_path("MANDEL_COSTMAP", ".mandel-costmap");
+	FILE *f;
+	int l;
 
-		/* And store it in the color_val[] array */
-		val = xterm_color(val);
-		color_val[n] = val;
+	/* Write a new file and rename it, so that readers never see half of it */
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+	if ((f = fopen(tmp, "w")) == NULL) {
+		perror("save_costmap: fopen");
+		return;
+	}
+	fprintf(f, "mandel-costmap %dx%d %.17g %.17g %.17g %.17g %d %d %.17g %.17g\n",
+		x_chars, y_chars, xmin, xmax, ymin, ymax,
+		max_iter, use_julia, julia_cx, julia_cy);
+	for (l = 0; l < y_chars; l++)
+		fprintf(f, "%.9f %lu\n", line_cost[l], line_iters[l]);
+	if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		perror("save_costmap: fclose/rename");
+		unlink(tmp);
 	}
 }
 
 /*
- * This function outputs an array of x_char color values
- * to a 256-color xterm.
+ * Split the lines of this render into chunks of equal estimated cost,
+ * of at most COST_MAX_LINES lines, using the cost map of an earlier
+ * render of the same set with the same iteration limit, if its view
+ * overlaps this one. Sets cost_chunks and cost_bounds[], or leaves
+ * cost_chunks at 0 if there is no such map.
+ *
+ * A line is estimated to cost as much per point as the line of the old
+ * view at the same y, or as the average point of the old view if there
+ * is none. The x ranges of the views are assumed to look alike.
  */
-void output_mandel_line(int fd, int color_val[])
+void plan_chunks(void)
 {
-	int i;
-	
-	char point ='@';
-	char newline='\n';
-
-	for (i = 0; i < x_chars; i++) {
-		/* Set the current color, then output the point */
-		set_xterm_color(fd, color_val[i]);
-		if (write(fd, &point, 1) != 1) {
-			perror("compute_and_output_mandel_line: write point");
-			exit(1);
+	int ox, oy, omax, ojulia, k, l, n, c;
+	double oxmin, oxmax, oymin, oymax, ojx, ojy, oystep;
+	double sum, total, *old, *est;
+	FILE *f;
+
+	if ((f = fopen(dotfile_path("MANDEL_COSTMAP", ".mandel-costmap"), "r")) == NULL)
+		return;
+	if (fscanf(f, "mandel-costmap %dx%d %lf %lf %lf %lf %d %d %lf %lf",
+		   &ox, &oy, &oxmin, &oxmax, &oymin, &oymax,
+		   &omax, &ojulia, &ojx, &ojy) != 10 || ox <= 0 || oy <= 0) {
+		fclose(f);
+		return;
+	}
+	if (omax != max_iter || ojulia != use_julia ||
+	    (use_julia && (ojx != julia_cx || ojy != julia_cy)) ||
+	    oxmax <= xmin || oxmin >= xmax || oymax <= ymin || oymin >= ymax) {
+		fclose(f);
+		return;
+	}
+
+	old = malloc(oy * sizeof(*old));
+	est = malloc(y_chars * sizeof(*est));
+	if (old == NULL || est == NULL) {
+		perror("plan_chunks: malloc");
+		exit(1);
+	}
+	for (k = 0, sum = 0; k < oy; k++) {
+		if (fscanf(f, "%lf %*s", &old[k]) != 1 || old[k] < 0) {
+			fclose(f);
+			free(old);
+			free(est);
+			return;
 		}
+		sum += old[k];
+	}
+	fclose(f);
+
+	/* Old line k is at y = oymax - k * oystep */
+	oystep = (oymax - oymin) / oy;
+	for (l = 0, total = 0; l < y_chars; l++) {
+		k = (int)floor((oymax - (ymax - l * ystep)) / oystep + 0.5);
+		est[l] = ((k >= 0 && k < oy) ? old[k] / ox : sum / ((double)ox * oy)) * x_chars;
+	}
+	free(old);
+
+	/*
+	 * Rows copied from their mirror image cost nothing, and the rows
+	 * they are copied from only what they cost themselves.
+	 */
+	for (l = 0; l < y_chars; l++) {
+		if (mirrored_row(l))
+			est[l] = 0;
+		total += est[l];
+	}
+	if (!(total > 0)) {
+		free(est);
+		return;
 	}
 
-	/* Now that the line is done, output a newline character */
-	if (write(fd, &newline, 1) != 1) {
-		perror("compute_and_output_mandel_line: write newline");
+	n = nworkers * COST_CHUNKS;
+	if (n > y_chars)
+		n = y_chars;
+	cost_bounds = malloc((n + y_chars / COST_MAX_LINES + 2) * sizeof(*cost_bounds));
+	if (cost_bounds == NULL) {
+		perror("plan_chunks: malloc");
 		exit(1);
 	}
+
+	/*
+	 * Cut after the line where the running sum reaches the next k / n
+	 * of the total, and where a chunk reaches COST_MAX_LINES lines.
+	 * c is the number of chunks so far.
+	 */
+	cost_bounds[0] = 0;
+	for (l = 0, k = 1, c = 1, sum = 0; l < y_chars && k < n; l++) {
+		sum += est[l];
+		/* ...but leave at least a line for each of the chunks after k */
+		if (sum >= total * k / n || y_chars - (l + 1) == n - k) {
+			cost_bounds[c++] = l + 1;
+			k++;
+		} else if (l + 1 - cost_bounds[c - 1] == COST_MAX_LINES) {
+			cost_bounds[c++] = l + 1;
+		}
+	}
+	for (; y_chars - cost_bounds[c - 1] > COST_MAX_LINES; c++)
+		cost_bounds[c] = cost_bounds[c - 1] + COST_MAX_LINES;
+	cost_bounds[c] = y_chars;
+	cost_chunks = c;
+	free(est);
+}
+
+/*
+ * Describe everything the pixels of the image depend on, as the key
+ * of its job. Floating point values in hex, so that they are exact.
+ */
+void job_key(char *buf, size_t len)
+{
+	snprintf(buf, len, "mandel %dx%d format %d colors %d ms %d prec %d max %d "
+		"view %a %a %a %a %a %a step %a %a julia %d %a %a\n",
+		x_chars, y_chars, image_fmt, color_map,
+		use_ms, prec, max_iter, view_cx.hi, view_cx.lo, view_cy.hi, view_cy.lo,
+		params.xmin, params.ymax, params.xstep, params.ystep,
+		use_julia, julia_cx, julia_cy);
+}
+
+/*
+ * The same for the saved orbits of the image, which do not depend
+ * on its format and colors, and which go on to a larger max.
+ */
+void orbits_key(char *buf, size_t len)
+{
+	snprintf(buf, len, "mandel orbits %dx%d prec %d "
+		"view %a %a %a %a %a %a step %a %a julia %d %a %a\n",
+		x_chars, y_chars, prec, view_cx.hi, view_cx.lo, view_cy.hi, view_cy.lo,
+		params.xmin, params.ymax, params.xstep, params.ystep,
+		use_julia, julia_cx, julia_cy);
 }
 
-void compute_and_output_mandel_line(int fd, int line, struct pipesem *sem)
+/*
+ * Render one frame with the current settings: start the workers,
+ * output what they compute, wait for them and report. Everything
+ * allocated for the frame but the framebuffer is released again,
+ * so that frames can be rendered one after the other.
+ */
+void render_frame(void)
 {
+	char key[JOB_KEY_MAX];
+	int i, status, ntiles = 0, done, failed = 0, from;
+	pid_t p;
+	pthread_t *tid = NULL;
+	struct sigaction sa;
+	sigset_t chld;
+
+	wall_time = cpu_time(CLOCK_MONOTONIC);
+	setup_view();
+
+	stats = alloc_shared(nworkers * sizeof(*stats));
+	busy = alloc_shared(nworkers * sizeof(*busy));
+	next_line = alloc_shared(sizeof(*next_line));
+	*next_line = 0;
+	line_cost = alloc_shared(y_chars * sizeof(*line_cost));
+	line_iters = alloc_shared(y_chars * sizeof(*line_iters));
+	if (use_costmap && chunk == 0 && !use_ms)
+		plan_chunks();
+	mandel_kernel_name();
+
+	if (use_ms) {
+		next_tile = alloc_shared(sizeof(*next_tile));
+		tiles_done = alloc_shared(((y_chars + MS_TILE - 1) / MS_TILE) * sizeof(*tiles_done));
+	}
+
+	if (use_job) {
+		ntiles = use_ms ? ((x_chars + MS_TILE - 1) / MS_TILE) * ((y_chars + MS_TILE - 1) / MS_TILE) : y_chars;
+		job_key(key, sizeof(key));
+		job_resumed = job_open(&job, image_path, key, ntiles);
+		if (job_resumed > 0 && !quiet)
+			fprintf(stderr, "Resuming job: %d of %d tiles done\n", job_resumed, ntiles);
+	}
+
+	/* Go on from the orbits saved by the last run, see -R */
+	if (use_image && use_orbits) {
+		orbits_key(key, sizeof(key));
+		from = orbits_open(&orbits, image_path, key, x_chars * y_chars);
+		/* Float only counts up to MANDEL_FLOAT_MAX_ITER, see setup_view() */
+		if (from < max_iter && !(prec == MANDEL_FLOAT && max_iter > MANDEL_FLOAT_MAX_ITER))
+			params.from = from;
+		if (params.from > 0 && !quiet)
+			fprintf(stderr, "Going on from the saved orbits of %d iterations\n", params.from);
+		orbit_zx = orbits.zx;
+		orbit_zy = orbits.zy;
+		orbit_iter = orbits.iter;
+	}
+
+	if (use_image) {
+		image_open(&image, image_path, image_fmt, color_map, x_chars, y_chars, max_iter,
+			use_job && job_resumed > 0);
+	} else if (use_framebuffer) {
+		if (framebuffer == NULL) {
+			framebuffer = alloc_shared((size_t)y_chars * x_chars * sizeof(*framebuffer));
+			row_ready = alloc_shared(y_chars * sizeof(*row_ready));
+		}
+		if (interactive && orbit_zx == NULL) {
+			orbit_zx = alloc_shared((size_t)y_chars * x_chars * sizeof(*orbit_zx));
+			orbit_zy = alloc_shared((size_t)y_chars * x_chars * sizeof(*orbit_zy));
+		}
+		orbit_iter = framebuffer;
+		memset(row_ready, 0, y_chars * sizeof(*row_ready));
+		pipesem_init(&rows_done, 0);
+	} else {
+		sem = malloc((nworkers + 1) * sizeof(*sem));
+		if (sem == NULL) {
+			perror("render_frame: malloc");
+			exit(1);
+		}
+		for (i = 0; i <= nworkers; i++)
+		{
+			pipesem_init(&sem[i], 0);
+		}
+	}
+
+	/* The file header goes out first, the workers only write strips */
+	if (use_stream) {
+		char header[IMAGE_HEADER_MAX];
+		size_t hlen = image_header(header, image_fmt, x_chars, y_chars, &stream_bpp);
+
+		if (insist_write(stream_fd, header, hlen) != hlen) {
+			perror("render_frame: write header");
+			exit(1);
+		}
+	}
+
+	if (use_threads) {
+		assert(nworkers > 0);
+		tid = calloc(nworkers, sizeof(*tid));
+		if (tid == NULL) {
+			perror("render_frame: calloc");
+			exit(1);
+		}
+		for (i = 0; i < nworkers; i++) {
+			if ((errno = pthread_create(&tid[i], NULL, worker_thread, (void *)(long)i)) != 0) {
+				perror("render_frame: pthread_create");
+				exit(1);
+			}
+		}
+	} else {
+		worker_pids = calloc(nworkers, sizeof(*worker_pids));
+		if (worker_pids == NULL) {
+			perror("render_frame: calloc");
+			exit(1);
+		}
+
+		/* Workers that write an image depend on nobody, see sigchld_handler() */
+		if (!use_image) {
+			sa.sa_handler = sigchld_handler;
+			sigemptyset(&sa.sa_mask);
+			sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+			if (sigaction(SIGCHLD, &sa, NULL) < 0) {
+				perror("render_frame: sigaction");
+				exit(1);
+			}
+		}
+
+		/* Not until worker_pids[] is filled in */
+		sigemptyset(&chld);
+		sigaddset(&chld, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &chld, NULL);
+		for (i = 0; i < nworkers; i++)
+		{
+			/* Do not let children inherit and flush our pending stdout */
+			fflush(stdout);
+			p = fork();
+			if (p < 0)
+			{				/*Error*/
+				perror("fork_procs: fork");
+				exit(1);
+			}
+			if (p == 0)
+			{				/* Child */
+				worker(i);
+				exit(0);
+			}
+			else if (!quiet && !use_stream)
+				printf("Parent, PID = %ld: Created child with PID = %ld.\n", (long)getpid(), (long)p);
+			worker_pids[i] = p;
+		}
+		sigprocmask(SIG_UNBLOCK, &chld, NULL);
+	}
+
+	if (use_image) {
+		/* Nothing to do until the workers are done */
+	} else if (use_framebuffer) {
+		fflush(stdout);
+		emit_framebuffer(1);
+		pipesem_destroy(&rows_done);
+	} else {
+		pipesem_signal(&sem[0]);
+
+		/* Workers still pass the ring around until the last one is done */
+		for (i = 0; i < nworkers; i++)
+			pipesem_wait(&sem[nworkers]);
+		for (i = 0; i <= nworkers; i++)
+			pipesem_destroy(&sem[i]);
+		free(sem);
+	}
+
+	if (!use_image && !use_stream && !use_truecolor && !use_sixel)
+		reset_xterm_color(1);
+
+	if (use_threads) {
+		for (i = 0; i < nworkers; i++) {
+			if ((errno = pthread_join(tid[i], NULL)) != 0) {
+				perror("render_frame: pthread_join");
+				exit(1);
+			}
+		}
+		free(tid);
+	} else {
+		/* Every worker is done with the others, wait for them as usual */
+		signal(SIGCHLD, SIG_DFL);
+		for (i = 0; i < nworkers; i++)
+		{
+			p = wait(&status);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				failed = 1;
+				explain_wait_status(p, status);
+			} else if (!quiet) {
+				explain_wait_status(p, status);
+			}
+		}
+		free(worker_pids);
+		worker_pids = NULL;
+	}
+
+	if (use_image)
+		image_close(&image);
+
+	/* Orbits are only good to go on from once every point is stored */
+	if (use_image && use_orbits) {
+		orbits_close(&orbits, (failed || (use_job && job_count(&job) < ntiles)) ? 0 : max_iter);
+		orbit_zx = orbit_zy = NULL;
+		orbit_iter = NULL;
+	}
+
+	/* A worker died: the tiles it did not finish are left for the next run */
+	if (use_job) {
+		done = job_count(&job);
+		job_close(&job);
+		if (done < ntiles) {
+			fprintf(stderr, "Job incomplete: %d of %d tiles done, run again to resume\n",
+				done, ntiles);
+			exit(1);
+		}
+	}
+
+	wall_time = cpu_time(CLOCK_MONOTONIC) - wall_time;
+	if (!quiet)
+		report_stats();
 	/*
-	 * A temporary array, used to hold color values for the line being drawn
+	 * Mariani-Silver works in tiles, and does not record line costs.
+	 * A resumed frame or job only recorded what it cost to go on.
 	 */
-	int color_val[x_chars];
+	if (use_costmap && !use_ms && params.from == 0 && !(use_job && job_resumed > 0))
+		save_costmap();
+	orbits_max = use_orbits ? max_iter : 0;
 
-	compute_mandel_line(line, color_val);
-	pipesem_wait(&sem[(line%NCHILDREN)]);
-	output_mandel_line(fd, color_val);
-	pipesem_signal(&sem[(line+1)%NCHILDREN]);
+	free_shared(stats, nworkers * sizeof(*stats));
+	free_shared(busy, nworkers * sizeof(*busy));
+	free_shared(next_line, sizeof(*next_line));
+	free_shared(line_cost, y_chars * sizeof(*line_cost));
+	free_shared(line_iters, y_chars * sizeof(*line_iters));
+	if (cost_chunks) {
+		free(cost_bounds);
+		cost_chunks = 0;
+	}
+	if (use_ms) {
+		free_shared(next_tile, sizeof(*next_tile));
+		free_shared(tiles_done, ((y_chars + MS_TILE - 1) / MS_TILE) * sizeof(*tiles_done));
+	}
+	if (use_deep)
+		deep_free(&deep);
 }
 
-void sigint_handler(int sig)
+/*
+ * Where the autotuning profile lives: $MANDEL_PROFILE,
+ * or .mandel-profile in the home directory.
+ */
+const char *profile_path(void)
 {
-	signal(SIGINT, SIG_IGN);
-	reset_xterm_color(1);
-	signal(SIGINT, SIG_DFL);
-	killpg(0, SIGINT);
+	return dotfile_path("MANDEL_PROFILE", ".mandel-profile");
+}
+
+/*
+ * Load the settings saved by autotune(), if there are any.
+ * Lines are "key=value", for the keys workers, chunk and kernel.
+ */
+void load_profile(void)
+{
+	char line[256], kernel[64];
+	FILE *f;
+	int val;
+
+	if ((f = fopen(profile_path(), "r")) == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "workers=%d", &val) == 1 && val > 0)
+			nworkers = val;
+		else if (sscanf(line, "chunk=%d", &val) == 1 && val >= 0)
+			chunk = val;
+		else if (sscanf(line, "kernel=%63s", kernel) == 1)
+			mandel_set_kernel(kernel);
+	}
+
+	fclose(f);
+}
+
+/*
+ * Render a trial frame AUTOTUNE_RUNS times, return the best wall time.
+ */
+double autotune_trial(void)
+{
+	double best = 0;
+	int run;
+
+	for (run = 0; run < AUTOTUNE_RUNS; run++) {
+		render_frame();
+		if (run == 0 || wall_time < best)
+			best = wall_time;
+	}
+	return best;
+}
+
+/*
+ * Find the fastest kernel, worker count and chunk size for this machine,
+ * by rendering trial frames of the current view into a temporary file,
+ * and save them to the profile.
+ *
+ * The kernel does not depend on how the work is distributed,
+ * so it is chosen first, with a single worker. Then every worker
+ * count from 1 up to the number of online CPUs, doubling, is tried
+ * with static distribution and with a few chunk sizes.
+ */
+void autotune(void)
+{
+	static const int chunks[] = { 0, 1, 2, 4, 8, 16 };
+	char tmp[] = "/tmp/mandel-autotune-XXXXXX";
+	const char *name, *best_kernel = NULL;
+	int i, w, c, fd, ncpu, best_workers = 1, best_chunk = 0;
+	double t, best = 0;
+	FILE *f;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		perror("autotune: mkstemp");
+		exit(1);
+	}
+	close(fd);
+
+	use_image = 1;
+	use_framebuffer = 0;
+	image_path = tmp;
+	image_fmt = IMAGE_RAW;
+	quiet = 1;
+	use_costmap = 0;
+	use_orbit_file = 0;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 0)
+		ncpu = 1;
+
+	nworkers = 1;
+	chunk = 0;
+	for (i = 0; (name = mandel_kernel_list(i)) != NULL; i++) {
+		mandel_set_kernel(name);
+		t = autotune_trial();
+		fprintf(stderr, "autotune: kernel %s: %.6fs\n", name, t);
+		if (best_kernel == NULL || t < best) {
+			best = t;
+			best_kernel = name;
+		}
+	}
+	mandel_set_kernel(best_kernel);
+
+	for (w = 1; ; w = (w * 2 < ncpu) ? w * 2 : ncpu) {
+		for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+			nworkers = w;
+			chunk = chunks[c];
+			t = autotune_trial();
+			fprintf(stderr, "autotune: %d workers, chunk %d: %.6fs\n", w, chunk, t);
+			if (t < best) {
+				best = t;
+				best_workers = w;
+				best_chunk = chunk;
+			}
+		}
+		if (w == ncpu)
+			break;
+	}
+	unlink(tmp);
+
+	if ((f = fopen(profile_path(), "w")) == NULL) {
+		perror("autotune: fopen");
+		exit(1);
+	}
+	fprintf(f, "workers=%d\nchunk=%d\nkernel=%s\n", best_workers, best_chunk, best_kernel);
+	if (fclose(f) != 0) {
+		perror("autotune: fclose");
+		exit(1);
+	}
+
+	fprintf(stderr, "autotune: best is %d workers, chunk %d, kernel %s, saved to %s\n",
+		best_workers, best_chunk, best_kernel, profile_path());
+}
+
+/*
+ * Interactive mode: render, then move the view with a key and render
+ * again, until 'q'. h, j, k, l or the arrow keys move by a quarter of
+ * the view, + and - zoom in and out by a factor of 2. c switches to
+ * the next color mapping, and only recolors the frame. i doubles the
+ * iterations, and only goes on with the points that ran out of them.
+ */
+void interact(void)
+{
+	struct termios raw;
+	char c, seq[2];
+
+	if (tcgetattr(0, &saved_tty) < 0) {
+		perror("interact: tcgetattr");
+		exit(1);
+	}
+	raw = saved_tty;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	if (tcsetattr(0, TCSANOW, &raw) < 0) {
+		perror("interact: tcsetattr");
+		exit(1);
+	}
+
+	render_frame();
+
+	/* From now on, the view is its center and radius */
+	if (!use_view) {
+		view_r = (xmax - xmin) / 2;
+		use_view = 1;
+	}
+
+	while (read(0, &c, 1) == 1 && c != 'q') {
+		/* Arrow keys are ESC [ A to ESC [ D */
+		if (c == '\033' && read(0, seq, 2) == 2 && seq[0] == '[')
+			c = (seq[1] == 'A') ? 'k' : (seq[1] == 'B') ? 'j' :
+			    (seq[1] == 'C') ? 'l' : (seq[1] == 'D') ? 'h' : c;
+
+		switch (c) {
+		case 'h':
+			view_cx = dd_add(view_cx, dd_from_double(-view_r / 4));
+			break;
+		case 'l':
+			view_cx = dd_add(view_cx, dd_from_double(view_r / 4));
+			break;
+		case 'k':
+			view_cy = dd_add(view_cy, dd_from_double(view_r / 4));
+			break;
+		case 'j':
+			view_cy = dd_add(view_cy, dd_from_double(-view_r / 4));
+			break;
+		case '+':
+		case '=':
+			view_r /= 2;
+			break;
+		case '-':
+			view_r *= 2;
+			break;
+		case 'c':
+			color_map = (color_map + 1) % MANDEL_COLOR_MAPS;
+			emit_framebuffer(1);
+			continue;
+		case 'i':
+			if (max_iter > INT_MAX / 2)
+				continue;
+			max_iter *= 2;
+			break;
+		default:
+			continue;
+		}
+		render_frame();
+	}
+
+	tcsetattr(0, TCSANOW, &saved_tty);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
 	signal(SIGINT, sigint_handler);
-	int line, i, status;
-	struct pipesem sem[NCHILDREN+1];
-	pid_t p;
-	xstep = (xmax - xmin) / x_chars;
-	ystep = (ymax - ymin) / y_chars;
-
-	for (i = 0; i <= NCHILDREN; i++)
-	{
-		pipesem_init(&sem[i], 0);
-	}
-	for (i = 0; i < NCHILDREN; i++)
-	{
-		p = fork();
-		if (p < 0)
-		{				/*Error*/
-			perror("fork_procs: fork");
+	int opt, tune = 0, sized = 0;
+	const char *daemon_path = NULL, *anim_path = NULL;
+	int pyramid_levels = -1;
+
+	load_profile();
+
+	while ((opt = getopt(argc, argv, "k:c:KftTX:In:ms:o:F:C:v:Zp:j:Si:bAD:a:JRP:")) != -1) {
+		switch (opt) {
+		case 'k':
+			if (mandel_set_kernel(optarg) < 0) {
+				fprintf(stderr, "%s: kernel `%s' unknown or not supported\n", argv[0], optarg);
+				exit(1);
+			}
+			break;
+		case 'c':
+			chunk = atoi(optarg);
+			if (chunk <= 0)
+				usage(argv[0]);
+			break;
+		case 'f':
+			use_framebuffer = 1;
+			break;
+		case 't':
+			use_threads = 1;
+			use_framebuffer = 1;
+			break;
+		case 'T':
+			use_truecolor = 1;
+			use_framebuffer = 1;
+			break;
+		case 'X':
+			sixel_colors = atoi(optarg);
+			if (sixel_colors < 2 || sixel_colors > SIXEL_COLORS)
+				usage(argv[0]);
+			use_sixel = 1;
+			use_framebuffer = 1;
+			break;
+		case 'I':
+			interactive = 1;
+			use_truecolor = 1;
+			use_framebuffer = 1;
+			break;
+		case 'm':
+			use_ms = 1;
+			use_framebuffer = 1;
+			break;
+		case 'n':
+			nworkers = atoi(optarg);
+			if (nworkers <= 0)
+				usage(argv[0]);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &x_chars, &y_chars) != 2 ||
+			    x_chars <= 0 || y_chars <= 0)
+				usage(argv[0]);
+			sized = 1;
+			break;
+		case 'o':
+			image_path = optarg;
+			use_image = 1;
+			break;
+		case 'F':
+			if ((image_fmt = image_format(optarg)) < 0)
+				usage(argv[0]);
+			break;
+		case 'C':
+			if ((color_map = mandel_color_map(optarg)) < 0)
+				usage(argv[0]);
+			break;
+		case 'v':
+			if (parse_view(optarg) < 0)
+				usage(argv[0]);
+			break;
+		case 'Z':
+			precision = MANDEL_DEEP;
+			break;
+		case 'j':
+			if (sscanf(optarg, "%lf,%lf", &julia_cx, &julia_cy) != 2)
+				usage(argv[0]);
+			use_julia = 1;
+			break;
+		case 'K':
+			use_costmap = 0;
+			break;
+		case 'S':
+			use_symmetry = 0;
+			break;
+		case 'p':
+			if (strcmp(optarg, "auto") == 0)
+				precision = 0;
+			else if (strcmp(optarg, "float") == 0)
+				precision = MANDEL_FLOAT;
+			else if (strcmp(optarg, "double") == 0)
+				precision = MANDEL_DOUBLE;
+			else if (strcmp(optarg, "deep") == 0)
+				precision = MANDEL_DEEP;
+			else
+				usage(argv[0]);
+			break;
+		case 'i':
+			max_iter = atoi(optarg);
+			if (max_iter <= 0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			bench_report = 1;
+			break;
+		case 'A':
+			tune = 1;
+			break;
+		case 'D':
+			daemon_path = optarg;
+			break;
+		case 'a':
+			anim_path = optarg;
+			break;
+		case 'J':
+			use_job = 1;
+			break;
+		case 'R':
+			use_orbit_file = 1;
+			break;
+		case 'P':
+			pyramid_levels = atoi(optarg);
+			if (pyramid_levels < 0 || pyramid_levels > PYRAMID_MAX_LEVEL)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (use_julia) {
+		if (precision == MANDEL_DEEP) {
+			fprintf(stderr, "%s: deep zoom is not supported for Julia sets\n", argv[0]);
 			exit(1);
 		}
-		if (p == 0)
-		{				/* Child */
-			for (line = i; line < y_chars; line+=NCHILDREN)
-			{
-				compute_and_output_mandel_line(1, line, sem);
-			}
-			pipesem_signal(&sem[NCHILDREN]);
-			exit(0);
+		/* Julia sets are centered at the origin */
+		if (!use_view) {
+			xmin = -1.5;
+			xmax = 1.5;
 		}
-		else printf("Parent, PID = %ld: Created child with PID = %ld.\n", (long)getpid(), (long)p);
 	}
-	pipesem_signal(&sem[0]);
 
-	for (i = 0; i < NCHILDREN; i++)
-	{
-		pipesem_wait(&sem[NCHILDREN]);
-		pipesem_destroy(&sem[i]);
+	/* The daemon, animations and pyramids render with a pool of threads, one per CPU by default */
+	if (daemon_path != NULL || anim_path != NULL || pyramid_levels >= 0) {
+		if (nworkers <= 0)
+			nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nworkers <= 0)
+			nworkers = 1;
+	}
+	if (daemon_path != NULL) {
+		daemon_run(daemon_path, nworkers, max_iter);
+		return 0;
+	}
+	if (anim_path != NULL) {
+		if (image_path == NULL) {
+			fprintf(stderr, "%s: -a needs -o with the frame file names, like zoom-%%04d.ppm\n",
+				argv[0]);
+			exit(1);
+		}
+		params.width = x_chars;
+		params.height = y_chars;
+		params.max = max_iter;
+		params.julia = use_julia;
+		params.julia_cx = julia_cx;
+		params.julia_cy = julia_cy;
+		params.precision = precision;
+		anim_run(anim_path, image_path, image_fmt, color_map, &params, nworkers);
+		return 0;
+	}
+	if (pyramid_levels >= 0) {
+		if (image_path == NULL) {
+			fprintf(stderr, "%s: -P needs -o with a directory or a .tar file\n", argv[0]);
+			exit(1);
+		}
+		/* Filling in tiles relies on properties of the Mandelbrot Set */
+		if (use_julia) {
+			fprintf(stderr, "%s: tile pyramids of Julia sets are not supported\n", argv[0]);
+			exit(1);
+		}
+		if (!use_view) {
+			view_cx = dd_from_double(PYRAMID_CX);
+			view_cy = dd_from_double(PYRAMID_CY);
+			view_r = PYRAMID_R;
+		}
+		pyramid_run(image_path, pyramid_levels, image_fmt, color_map, max_iter, precision,
+			view_cx, view_cy, view_r, nworkers);
+		return 0;
 	}
 
-	pipesem_destroy(&sem[NCHILDREN]);
+	if (tune) {
+		if (!sized) {
+			x_chars = AUTOTUNE_WIDTH;
+			y_chars = AUTOTUNE_HEIGHT;
+		}
+		autotune();
+		return 0;
+	}
 
-	reset_xterm_color(1);
+	/*
+	 * Stdout and pipes cannot be mapped, stream those in strips.
+	 * Mariani-Silver renders tiles, not strips, so it is left out.
+	 */
+	if (use_image && (stream_fd = stream_open(image_path)) >= 0) {
+		use_image = use_ms = 0;
+		use_stream = 1;
+		if (chunk == 0)
+			chunk = STREAM_LINES;
+	}
+
+	if (use_job && !use_image) {
+		fprintf(stderr, "%s: -J needs -o with an image file\n", argv[0]);
+		exit(1);
+	}
+	if (use_orbit_file && !use_image) {
+		fprintf(stderr, "%s: -R needs -o with an image file\n", argv[0]);
+		exit(1);
+	}
 
-	for (i = 0; i < NCHILDREN; i++)
-	{
-		p = wait(&status);
-		explain_wait_status(p, status);
+	/* Workers write the image themselves, there is nothing to emit */
+	if (use_image || use_stream)
+		use_framebuffer = use_truecolor = interactive = use_sixel = 0;
+
+	if (use_sixel) {
+		use_truecolor = interactive = 0;
+		if (!sized) {
+			x_chars = SIXEL_WIDTH;
+			y_chars = SIXEL_HEIGHT;
+		}
+		sixel_init(&sixel, x_chars, y_chars, sixel_colors);
+	}
+
+	if (use_truecolor) {
+		term_init(&screen, x_chars, y_chars);
+		y_chars *= 2;
 	}
+	/* Nothing but the picture on the screen */
+	if (interactive)
+		quiet = 1;
 
+	if (nworkers == 0)
+		nworkers = use_threads ? sysconf(_SC_NPROCESSORS_ONLN) : NCHILDREN;
+	if (nworkers <= 0)
+		nworkers = 1;
+
+	if (interactive)
+		interact();
+	else
+		render_frame();
+
+	free_framebuffer();
+	if (use_truecolor)
+		term_free(&screen);
+	if (use_sixel)
+		sixel_free(&sixel);
+	if (use_stream && stream_fd != 1 && close(stream_fd) < 0) {
+		perror("close");
+		exit(1);
+	}
 	return 0;
 }